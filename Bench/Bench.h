@@ -0,0 +1,126 @@
+#pragma once
+
+// tiny helpers shared by the micro benchmarks in this folder
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <random>
+
+namespace Bench {
+
+using Clock = std::chrono::steady_clock;
+
+// run fn a couple of times and return the fastest run in seconds
+template <class Fn>
+static double best_of(int runs, Fn&& fn)
+{
+    double best = 1e30;
+    for (int n = 0; n < runs; ++n) {
+        auto begin = Clock::now();
+        fn();
+        std::chrono::duration<double> elapsed = Clock::now() - begin;
+        if (elapsed.count() < best) { best = elapsed.count(); }
+    }
+    return best;
+}
+
+// random arithmetic chain like "(3 + 1.5) * 7 - 2 / 4 + ..." with 'terms' number literals
+static inline std::string arithmetic_script(int terms, unsigned seed)
+{
+    static const char ops[] = { '+', '-', '*', '/' };
+
+    std::mt19937 rng(seed);
+    std::string src;
+    for (int n = 0; n < terms; ++n) {
+        if (n > 0) {
+            src += ' ';
+            src += ops[rng() % 4];
+            src += ' ';
+        }
+        bool group = (rng() % 8 == 0) && n + 1 < terms;
+        if (group) { src += '('; }
+        src += std::to_string(rng() % 100 + 1);
+        if (rng() % 3 == 0) { src += ".5"; }
+        if (group) {
+            src += " + ";
+            src += std::to_string(rng() % 10);
+            src += ')';
+            ++n;
+        }
+    }
+    return src;
+}
+
+// 'blocks' right nested expressions like "(1 + (2 * (3 - ...)))" of 'depth' levels
+// each, added up. Keeps the parser recursing and the value stack 'depth' deep.
+static inline std::string nested_script(int depth, int blocks, unsigned seed)
+{
+    static const char ops[] = { '+', '-', '*' };
+
+    std::mt19937 rng(seed);
+    std::string src;
+    for (int block = 0; block < blocks; ++block) {
+        if (block > 0) { src += " + "; }
+        for (int level = 0; level < depth; ++level) {
+            src += '(';
+            src += std::to_string(rng() % 9 + 1);
+            src += ' ';
+            src += ops[rng() % 3];
+            src += ' ';
+        }
+        src += '1';
+        src.append(depth, ')');
+    }
+    return src;
+}
+
+// a sum of 'count' distinct number literals, beyond 256 they need OP_Constant_Long
+static inline std::string constant_pool_script(int count, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::string src;
+    for (int n = 0; n < count; ++n) {
+        if (n > 0) { src += (rng() % 2) ? " + " : " - "; }
+        src += std::to_string(n);
+        src += '.';
+        src += std::to_string(rng() % 9 + 1);
+    }
+    return src;
+}
+
+// generated lexer input of about 'bytes' size: identifiers, keywords, numbers,
+// strings, comments and indentation, roughly like machine written scripts
+static inline std::string lexer_script(std::size_t bytes, unsigned seed)
+{
+    static const char* words[] = {
+        "value", "result_total", "x", "counter2", "and", "or", "print", "var", "while",
+        "return", "this", "true", "false", "nil", "fun", "class", "temperature_sensor_17",
+    };
+    static const char* symbols[] = { "+", "-", "*", "/", "(", ")", ";", "==", "!=", "<=", ">", "," };
+
+    std::mt19937 rng(seed);
+    std::string src;
+    src.reserve(bytes + 256);
+    while (src.size() < bytes) {
+        src.append(rng() % 3 * 4, ' '); // indentation
+        int tokens = 4 + rng() % 12;
+        for (int n = 0; n < tokens; ++n) {
+            switch (rng() % 6) {
+            case 0: case 1: src += words[rng() % (sizeof(words) / sizeof(words[0]))]; break;
+            case 2: src += std::to_string(rng() % 100000); if (rng() % 2) { src += ".25"; } break;
+            case 3: src += symbols[rng() % (sizeof(symbols) / sizeof(symbols[0]))]; break;
+            case 4: src += "\"some string literal with spaces\""; break;
+            case 5: src += "\t"; break;
+            }
+            src += ' ';
+        }
+        if (rng() % 4 == 0) {
+            src += "// a comment explaining the line above in a few words";
+        }
+        src += '\n';
+    }
+    return src;
+}
+
+}
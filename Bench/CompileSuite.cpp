@@ -0,0 +1,32 @@
+// Benchmark suite: compiler throughput (scanner + parser + emitter, and the
+// optimizer with -O1) in source bytes. See Suite.h.
+//
+//   cmake -S .. -B build && cmake --build build --target bench_compile
+//   build/bench_compile --size=2097152 --json=compile.json
+
+#include "Suite.h"
+
+int main(int argc, const char** argv)
+{
+    Bench::Report report;
+    report.suite = "compile";
+    report.unit = "byte";
+    report.options = Bench::parse_options(argc, argv, 2 << 20);
+
+    Compiler compiler;
+    compiler.opt_level = report.options.opt_level;
+
+    for (auto const& workload : Bench::workloads(report.options.size)) {
+        double code_bytes = 0;
+        double seconds = Bench::best_of(report.options.runs, [&] {
+            code_bytes = 0;
+            for (auto const& script : workload.scripts) {
+                ChunkRef chunk = compiler.compile(script);
+                code_bytes += (chunk != nullptr) ? (double)chunk->code.size() : -1e9;
+            }
+        });
+        report.add({ workload.name, workload.bytes, (double)workload.bytes, seconds, code_bytes });
+    }
+
+    return report.write() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,54 @@
+// Dispatch loop benchmark.
+//
+// Runs the same compiled arithmetic chunks through VM::run over and over. Build it
+// once with the threaded dispatch and once with the switch and compare:
+//
+//   g++ -std=c++17 -O2 -I.. DispatchBench.cpp -o dispatch_threaded
+//   g++ -std=c++17 -O2 -I.. -DNO_COMPUTED_GOTO DispatchBench.cpp -o dispatch_switch
+
+#include <vector>
+
+#include "Bench.h"
+#include "../VM.h"
+
+int main()
+{
+    const int scripts = 64;
+    const int terms = 200;
+    const int iterations = 2000;
+
+    // one VM per chunk, so the timed loop doesn't reload chunks
+    Compiler compiler;
+    std::vector<VM> vms(scripts);
+    std::size_t instructions = 0;
+    for (int n = 0; n < scripts; ++n) {
+        VM& vm = vms[n];
+        vm.chunk = compiler.compile(Bench::arithmetic_script(terms, n));
+        vm.load(*vm.chunk);
+        instructions += vm.chunk->code.size();
+    }
+
+    Number checksum = 0;
+    double seconds = Bench::best_of(5, [&] {
+        for (int i = 0; i < iterations; ++i) {
+            for (auto& vm : vms) {
+                vm.ip = vm.program.code;
+                vm.reset_stack();
+                vm.run();
+                checksum += AS_NUMBER(vm.result);
+            }
+        }
+    });
+
+#if defined(COMPUTED_GOTO)
+    const char* dispatch = "computed goto";
+#else
+    const char* dispatch = "switch";
+#endif
+
+    std::printf("dispatch         : %s\n", dispatch);
+    std::printf("time             : %.3f ms\n", seconds * 1e3);
+    std::printf("per instruction  : %.2f ns\n", seconds * 1e9 / ((double)instructions * iterations));
+    std::printf("checksum         : %g\n", checksum);
+    return 0;
+}
@@ -0,0 +1,67 @@
+// Baseline JIT benchmark.
+//
+// Runs the compiled suite workloads (see Suite.h) with VM::run and as machine code
+// from Jit::compile and compares the time per run. Both have to compute the same
+// results. Without the JIT (not x86-64 Linux, or built with NO_JIT) there is
+// nothing to compare.
+//
+//   cmake -S .. -B build && cmake --build build --target jit_bench
+//   build/jit_bench --size=262144 -O1
+
+#include "Suite.h"
+
+int main(int argc, const char** argv)
+{
+    const int iterations = 50;
+    Bench::Options options = Bench::parse_options(argc, argv, 256 << 10);
+
+    Compiler compiler;
+    compiler.opt_level = options.opt_level;
+
+    bool same = true;
+    std::printf("%-12s %10s %12s %12s %10s %8s\n", "workload", "chunks", "machine KB", "interp ms", "jit ms", "speedup");
+    for (auto const& workload : Bench::workloads(options.size)) {
+        std::vector<VM> vms(workload.scripts.size());
+        std::vector<std::unique_ptr<Jit::Code>> native(workload.scripts.size());
+        std::size_t machine_bytes = 0;
+        for (std::size_t n = 0; n < vms.size(); ++n) {
+            vms[n].chunk = compiler.compile(workload.scripts[n]);
+            vms[n].load(*vms[n].chunk);
+            native[n] = Jit::compile(*vms[n].chunk);
+            if (native[n] == nullptr) {
+                std::printf("no JIT in this build\n");
+                return EXIT_FAILURE;
+            }
+            machine_bytes += native[n]->size;
+        }
+
+        double interpreted_sum = 0;
+        double interpreted = Bench::best_of(options.runs, [&] {
+            interpreted_sum = 0;
+            for (int i = 0; i < iterations; ++i) {
+                for (auto& vm : vms) {
+                    vm.ip = vm.program.code;
+                    vm.reset_stack();
+                    vm.run();
+                    interpreted_sum += AS_NUMBER(vm.result);
+                }
+            }
+        });
+
+        double native_sum = 0;
+        double jitted = Bench::best_of(options.runs, [&] {
+            native_sum = 0;
+            for (int i = 0; i < iterations; ++i) {
+                for (std::size_t n = 0; n < vms.size(); ++n) {
+                    vms[n].run_native(*native[n]);
+                    native_sum += AS_NUMBER(vms[n].result);
+                }
+            }
+        });
+
+        same = same && interpreted_sum == native_sum;
+        std::printf("%-12s %10zu %12.1f %12.3f %10.3f %8.2f%s\n", workload.name.c_str(), vms.size(), machine_bytes / 1024.0,
+                    interpreted * 1e3, jitted * 1e3, interpreted / jitted, interpreted_sum == native_sum ? "" : "  MISMATCH");
+    }
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
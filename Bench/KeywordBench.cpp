@@ -0,0 +1,105 @@
+// Keyword recognition benchmark.
+//
+// Classifies a long list of identifiers and keywords with the perfect hash from
+// Keywords.h and with the hand written trie the scanner used before, and checks
+// both agree on every word.
+//
+//   g++ -std=c++17 -O2 -I.. KeywordBench.cpp -o keyword_bench
+
+#include <vector>
+
+#include "Bench.h"
+#include "../Keywords.h"
+
+// the former Scanner::identifier_type, kept as the baseline
+namespace Trie {
+
+static Token::Type check_keyword(const char* start, int length, int begin, int rest_length, const char* rest, Token::Type type)
+{
+    if (length == begin + rest_length && std::memcmp(start + begin, rest, rest_length) == 0) {
+        return type;
+    }
+    return Token::Identifier;
+}
+
+static Token::Type identifier_type(const char* start, int length)
+{
+    switch (start[0]) {
+    case 'a': return check_keyword(start, length, 1, 2, "nd", Token::And);
+    case 'c': return check_keyword(start, length, 1, 4, "lass", Token::Class);
+    case 'e': return check_keyword(start, length, 1, 3, "lse", Token::Else);
+    case 'f':
+        if (length > 1) {
+            switch (start[1]) {
+            case 'a': return check_keyword(start, length, 2, 3, "lse", Token::False);
+            case 'o': return check_keyword(start, length, 2, 1, "r", Token::For);
+            case 'u': return check_keyword(start, length, 2, 1, "n", Token::Fun);
+            }
+        }
+        break;
+    case 'i': return check_keyword(start, length, 1, 1, "f", Token::If);
+    case 'n': return check_keyword(start, length, 1, 2, "il", Token::Nil);
+    case 'o': return check_keyword(start, length, 1, 1, "r", Token::Or);
+    case 'p': return check_keyword(start, length, 1, 4, "rint", Token::Print);
+    case 'r': return check_keyword(start, length, 1, 5, "eturn", Token::Return);
+    case 's': return check_keyword(start, length, 1, 4, "uper", Token::Super);
+    case 't':
+        if (length > 1) {
+            switch (start[1]) {
+            case 'h': return check_keyword(start, length, 2, 2, "is", Token::This);
+            case 'r': return check_keyword(start, length, 2, 2, "ue", Token::True);
+            }
+        }
+        break;
+    case 'v': return check_keyword(start, length, 1, 2, "ar", Token::Var);
+    case 'w': return check_keyword(start, length, 1, 4, "hile", Token::While);
+    }
+    return Token::Identifier;
+}
+
+}
+
+int main()
+{
+    // identifier dense input: keywords, near misses and ordinary names
+    static const char* samples[] = {
+        "and", "class", "else", "false", "for", "fun", "if", "nil", "or", "print",
+        "return", "super", "this", "true", "var", "while",
+        "an", "classy", "elsewhere", "fals", "form", "funny", "iff", "nils", "order",
+        "printer", "returned", "superb", "these", "truth", "variable", "whilst",
+        "x", "y", "total", "sum", "value", "count", "index", "temperature", "result",
+    };
+
+    std::mt19937 rng(3);
+    std::vector<std::string> words(1 << 20);
+    for (auto& word : words) {
+        word = samples[rng() % (sizeof(samples) / sizeof(samples[0]))];
+    }
+
+    for (auto const& word : words) {
+        if (Trie::identifier_type(word.data(), (int)word.size()) != Keywords::lookup(word.data(), word.size())) {
+            std::printf("mismatch for '%s'\n", word.c_str());
+            return 1;
+        }
+    }
+
+    const int rounds = 20;
+    long checksum = 0;
+    double trie = Bench::best_of(5, [&] {
+        for (int r = 0; r < rounds; ++r) {
+            for (auto const& word : words) { checksum += Trie::identifier_type(word.data(), (int)word.size()); }
+        }
+    });
+    double hash = Bench::best_of(5, [&] {
+        for (int r = 0; r < rounds; ++r) {
+            for (auto const& word : words) { checksum += Keywords::lookup(word.data(), word.size()); }
+        }
+    });
+
+    const double lookups = (double)words.size() * rounds;
+    std::printf("hash params      : a = %u, b = %u\n", Keywords::params.a, Keywords::params.b);
+    std::printf("trie             : %.2f ns/lookup\n", trie * 1e9 / lookups);
+    std::printf("perfect hash     : %.2f ns/lookup\n", hash * 1e9 / lookups);
+    std::printf("checksum         : %ld\n", checksum);
+    return 0;
+}
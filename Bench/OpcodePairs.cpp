@@ -0,0 +1,116 @@
+// Opcode pair frequencies and superinstructions.
+//
+// Compiles the arithmetic corpus without superinstructions and counts which
+// opcode follows which (the scripts are straight line code, so the static counts
+// are the dynamic ones). The superinstructions in OpCodes.h cover the top pairs.
+// Then runs the corpus with and without them, checks both agree on every result
+// and compares dispatches and time.
+//
+//   g++ -std=c++17 -O2 -I.. OpcodePairs.cpp -o opcode_pairs
+
+#include <algorithm>
+#include <vector>
+
+#include "Bench.h"
+#include "../VM.h"
+
+struct Corpus {
+    std::vector<ChunkRef> chunks;
+    std::size_t instructions = 0;
+};
+
+static std::size_t count_instructions(Chunk const& chunk)
+{
+    std::size_t count = 0;
+    for (Index offset = 0; offset < (Index)chunk.code.size(); offset += 1 + op_info(chunk.code[offset]).operands) {
+        count++;
+    }
+    return count;
+}
+
+static Corpus compile_corpus(int scripts, int terms, bool superinstructions)
+{
+    Compiler compiler;
+    compiler.superinstructions = superinstructions;
+
+    Corpus corpus;
+    for (int n = 0; n < scripts; ++n) {
+        corpus.chunks.push_back(compiler.compile(Bench::arithmetic_script(terms, n)));
+        corpus.instructions += count_instructions(*corpus.chunks.back());
+    }
+    return corpus;
+}
+
+static void print_pairs(Corpus const& corpus)
+{
+    std::vector<std::size_t> pairs(OP_Count * OP_Count);
+    std::size_t total = 0;
+    for (auto const& chunk : corpus.chunks) {
+        Byte previous = 0;
+        for (Index offset = 0; offset < (Index)chunk->code.size(); offset += 1 + op_info(chunk->code[offset]).operands) {
+            Byte op = chunk->code[offset];
+            if (previous != 0) {
+                pairs[previous * OP_Count + op]++;
+                total++;
+            }
+            previous = op;
+        }
+    }
+
+    std::vector<int> order(pairs.size());
+    for (int n = 0; n < (int)order.size(); ++n) { order[n] = n; }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return pairs[a] > pairs[b]; });
+
+    std::printf("opcode pairs (unfused)\n");
+    for (int n = 0; n < 8 && pairs[order[n]] > 0; ++n) {
+        int pair = order[n];
+        std::printf("  %-14s %-14s %6.2f %%\n", Debug::op_name((Byte)(pair / OP_Count)), Debug::op_name((Byte)(pair % OP_Count)),
+                    100.0 * pairs[pair] / total);
+    }
+}
+
+static double run_corpus(Corpus const& corpus, int iterations, std::vector<Value>& results)
+{
+    std::vector<VM> vms(corpus.chunks.size());
+    for (std::size_t n = 0; n < vms.size(); ++n) {
+        vms[n].chunk = corpus.chunks[n];
+        vms[n].load(*vms[n].chunk);
+    }
+
+    return Bench::best_of(5, [&] {
+        results.clear();
+        for (int i = 0; i < iterations; ++i) {
+            for (auto& vm : vms) {
+                vm.ip = vm.program.code;
+                vm.reset_stack();
+                vm.run();
+                if (i == 0) { results.push_back(vm.result); }
+            }
+        }
+    });
+}
+
+int main()
+{
+    const int scripts = 64;
+    const int terms = 200;
+    const int iterations = 2000;
+
+    Corpus plain = compile_corpus(scripts, terms, false);
+    Corpus fused = compile_corpus(scripts, terms, true);
+    print_pairs(plain);
+
+    std::vector<Value> plain_results, fused_results;
+    double plain_seconds = run_corpus(plain, iterations, plain_results);
+    double fused_seconds = run_corpus(fused, iterations, fused_results);
+
+    bool same = plain_results.size() == fused_results.size();
+    for (std::size_t n = 0; same && n < plain_results.size(); ++n) {
+        same = values_identical(plain_results[n], fused_results[n]);
+    }
+
+    std::printf("dispatches       : %zu -> %zu\n", plain.instructions, fused.instructions);
+    std::printf("time             : %.3f ms -> %.3f ms\n", plain_seconds * 1e3, fused_seconds * 1e3);
+    std::printf("results          : %s\n", same ? "identical" : "DIFFERENT");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+// Parallel lexer scaling benchmark.
+//
+// Scans a generated script sequentially and with ParallelLexer::scan on 1, 2, 4...
+// threads up to the number of cores, checks that every token stream matches the
+// sequential one and prints the speedup. The script has multi-line strings every
+// few lines, so some pieces start inside a string and have to be rescanned.
+//
+//   g++ -std=c++17 -O2 -pthread -I.. ParallelLexBench.cpp -o parallel_lex_bench
+//   ./parallel_lex_bench [megabytes] [max threads, default: the cores]
+
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "Bench.h"
+#include "../ParallelLexer.h"
+
+static std::vector<Token> sequential_tokens(std::string const& src, std::vector<double>& numbers)
+{
+    Scanner scanner(src.data(), (Size)src.size());
+    std::vector<Token> tokens;
+    forever {
+        Token token = scanner.scan_token();
+        tokens.push_back(token);
+        if (token.type == Token::Eof) { break; }
+    }
+    numbers = std::move(scanner.numbers);
+    return tokens;
+}
+
+static bool same_tokens(std::vector<Token> const& expected, std::vector<double> const& numbers, Scanner const& scanner)
+{
+    if (scanner.scanned.size() != expected.size()) { return false; }
+    for (std::size_t n = 0; n < expected.size(); ++n) {
+        Token a = expected[n];
+        Token b = scanner.scanned[n];
+        if (a.offset != b.offset || a.length != b.length || a.type != b.type) { return false; }
+        if (a.type == Token::Number && numbers[a.literal] != scanner.numbers[b.literal]) { return false; }
+    }
+    return true;
+}
+
+int main(int argc, const char** argv)
+{
+    const std::size_t megabytes = (argc > 1) ? std::atoi(argv[1]) : 64;
+
+    std::string src;
+    for (unsigned seed = 0; src.size() < (megabytes << 20); ++seed) {
+        src += Bench::lexer_script(16 << 10, seed);
+        src += "print \"a string\nover three\nlines\";\n";
+    }
+
+    std::vector<double> numbers;
+    std::vector<Token> expected;
+    double sequential = Bench::best_of(5, [&] { expected = sequential_tokens(src, numbers); });
+
+    int cores = (argc > 2) ? std::atoi(argv[2]) : (int)std::thread::hardware_concurrency();
+    std::printf("input            : %zu bytes, %zu tokens, up to %d threads\n", src.size(), expected.size(), cores);
+    std::printf("%-8s %10s %12s %8s\n", "threads", "ms", "Mtokens/s", "speedup");
+    std::printf("%-8s %10.3f %12.1f %8.2f\n", "seq", sequential * 1e3, expected.size() / sequential / 1e6, 1.0);
+
+    bool ok = true;
+    for (int threads = 1; threads <= std::max(cores, 1); threads *= 2) {
+        Scanner scanner(src.data(), (Size)src.size());
+        double seconds = Bench::best_of(5, [&] { ParallelLexer::scan(scanner, threads); });
+        bool same = same_tokens(expected, numbers, scanner);
+        ok = ok && same;
+        std::printf("%-8d %10.3f %12.1f %8.2f%s\n", threads, seconds * 1e3, expected.size() / seconds / 1e6,
+                    sequential / seconds, same ? "" : "  MISMATCH");
+        if (threads < cores && threads * 2 > cores) { threads = cores / 2; } // end with all the cores
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+// Hardware counter benchmark.
+//
+// Measures the three phases (Scanner::scan_token, Compiler::compile, VM::run) and
+// single opcodes with a perf_event_open counter group each: instructions, cycles,
+// IPC, branch misses and L1d/LLC misses. Every number is divided by the work done
+// in the phase: tokens, source bytes or executed instructions. Without counters
+// (not Linux, or no permission, as inside most containers) only the time is shown.
+//
+//   g++ -std=c++17 -O2 -I.. PerfBench.cpp -o perf_bench
+//   g++ -std=c++17 -O2 -I.. -DNO_COMPUTED_GOTO PerfBench.cpp -o perf_bench_switch
+
+#include <vector>
+
+#include "Bench.h"
+#include "PerfCounters.h"
+#include "../VM.h"
+
+static std::size_t count_instructions(ChunkView const& chunk)
+{
+    std::size_t count = 0;
+    for (Index offset = 0; offset < chunk.code_size; offset += 1 + op_info(chunk.code[offset]).operands) {
+        count++;
+    }
+    return count;
+}
+
+// runs every VM from the start 'iterations' times, the caller counts the instructions
+static void run_all(std::vector<VM>& vms, int iterations, Number& checksum)
+{
+    for (int i = 0; i < iterations; ++i) {
+        for (auto& vm : vms) {
+            vm.ip = vm.program.code;
+            vm.reset_stack();
+            vm.run();
+            checksum += AS_NUMBER(vm.result);
+        }
+    }
+}
+
+// a chunk that executes 'op' (fused with a constant or after one) 'count' times
+static ChunkRef opcode_chunk(OpCode op, int count)
+{
+    auto chunk = std::make_shared<Chunk>();
+    Index one = chunk->add_const(1.0);
+    chunk->write_constant(one, 1);
+    for (int n = 0; n < count; ++n) {
+        if (op_info(op).operands == 1) {
+            chunk->write(op, 1);
+            chunk->write((Byte)one, 1);
+        }
+        else {
+            chunk->write_constant(one, 1);
+            chunk->write(op, 1);
+        }
+    }
+    chunk->write(OP_Return, 1);
+    chunk->max_stack = 2;
+    return chunk;
+}
+
+int main()
+{
+    PerfCounters::Group group;
+    if (!group.open()) {
+        std::printf("hardware counters unavailable (%s), showing wall time only\n\n", group.error.c_str());
+    }
+    PerfCounters::print_header();
+
+    // scanner
+    std::string source = Bench::lexer_script(8 << 20, 1);
+    std::size_t tokens = 0;
+    auto sample = PerfCounters::measure(group, [&] {
+        Scanner scanner(source.data(), (Size)source.size());
+        while (scanner.scan_token().type != Token::Eof) { tokens++; }
+    });
+    PerfCounters::print("scan_token (token)", sample, (double)tokens);
+
+    // compiler
+    std::vector<std::string> scripts;
+    std::size_t bytes = 0;
+    for (int n = 0; n < 256; ++n) {
+        scripts.push_back(Bench::arithmetic_script(400, n));
+        bytes += scripts.back().size();
+    }
+    Compiler compiler;
+    std::vector<ChunkRef> chunks;
+    sample = PerfCounters::measure(group, [&] {
+        for (auto const& script : scripts) {
+            chunks.push_back(compiler.compile(script));
+        }
+    });
+    PerfCounters::print("compile (source byte)", sample, (double)bytes);
+
+    // dispatch loop over the compiled scripts
+    const int iterations = 200;
+    std::vector<VM> vms(chunks.size());
+    std::size_t executed = 0;
+    for (std::size_t n = 0; n < chunks.size(); ++n) {
+        vms[n].chunk = chunks[n];
+        vms[n].load(*chunks[n]);
+        executed += count_instructions(*chunks[n]) * iterations;
+    }
+    Number checksum = 0;
+    run_all(vms, 1, checksum); // warm up and quicken
+    sample = PerfCounters::measure(group, [&] { run_all(vms, iterations, checksum); });
+    PerfCounters::print("run (instruction)", sample, (double)executed);
+
+    // single opcodes, the constants around them are included in the count
+    std::printf("\n");
+    for (OpCode op : { OP_Add, OP_Multiply, OP_Divide, OP_Add_Const, OP_Multiply_Const, OP_Divide_Const }) {
+        std::vector<VM> single(1);
+        single[0].chunk = opcode_chunk(op, 10000);
+        single[0].load(*single[0].chunk);
+        run_all(single, 1, checksum);
+        std::size_t count = count_instructions(*single[0].chunk) * 1000;
+        sample = PerfCounters::measure(group, [&] { run_all(single, 1000, checksum); });
+        PerfCounters::print(Debug::op_name(op), sample, (double)count);
+    }
+
+    std::printf("\nchecksum %g\n", checksum);
+    return 0;
+}
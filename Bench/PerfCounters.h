@@ -0,0 +1,212 @@
+#pragma once
+
+// Hardware performance counters for the benchmarks: one perf_event_open group per
+// measurement, so all counters cover exactly the same instructions. Only Linux
+// has them, and even there they are often missing (containers, VMs, a strict
+// perf_event_paranoid). Then open() fails with the reason and the benchmarks
+// fall back to wall time. Events the CPU doesn't support are left out one by one.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "Bench.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace PerfCounters {
+
+enum Event {
+    Instructions,
+    Cycles,
+    Branches,
+    BranchMisses,
+    L1DMisses,
+    LLCMisses,
+    EventCount
+};
+
+static const char* const event_names[EventCount] = {
+    "instructions", "cycles", "branches", "branch-misses", "L1d-misses", "LLC-misses",
+};
+
+struct Sample {
+    uint64_t values[EventCount] = {};
+    bool counted[EventCount] = {};
+    double seconds = 0;
+};
+
+struct Group {
+    int fds[EventCount];
+    int order[EventCount]; // position of an event in the group read, -1 if it isn't counted
+    int members = 0;
+    std::string error; // why there are no counters
+
+    Group()
+    {
+        for (int n = 0; n < EventCount; ++n) { fds[n] = -1; order[n] = -1; }
+    }
+    Group(Group const&) = delete;
+    Group& operator=(Group const&) = delete;
+
+    ~Group()
+    {
+        close();
+    }
+
+    bool available() const
+    {
+        return members > 0;
+    }
+
+#if defined(__linux__)
+    static int open_event(Event event, int group_fd)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.disabled = (group_fd == -1); // the leader starts the whole group
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        switch (event) {
+        case Instructions: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case Cycles:       attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case Branches:     attr.config = PERF_COUNT_HW_BRANCH_INSTRUCTIONS; break;
+        case BranchMisses: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+        case LLCMisses:    attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+        case L1DMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default: return -1;
+        }
+
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+    }
+
+    bool open()
+    {
+        close();
+        for (int n = 0; n < EventCount; ++n) {
+            int fd = open_event((Event)n, fds[Instructions]);
+            if (fd < 0) {
+                if (n == Instructions) {
+                    error = std::string("perf_event_open: ") + std::strerror(errno);
+                    return false;
+                }
+                continue; // not supported here, count the others
+            }
+            fds[n] = fd;
+            order[n] = members++;
+        }
+        return true;
+    }
+
+    void start()
+    {
+        if (!available()) { return; }
+        ioctl(fds[Instructions], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[Instructions], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    void stop(Sample& sample)
+    {
+        if (!available()) { return; }
+        ioctl(fds[Instructions], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // { nr, time_enabled, time_running, values[nr] }
+        uint64_t data[3 + EventCount] = {};
+        if (read(fds[Instructions], data, sizeof(data)) < (ssize_t)(3 * sizeof(uint64_t))) { return; }
+
+        // scale up when the kernel had to multiplex the counters
+        double scale = (data[2] > 0) ? (double)data[1] / (double)data[2] : 1.0;
+        for (int n = 0; n < EventCount; ++n) {
+            if (order[n] < 0 || order[n] >= (int)data[0]) { continue; }
+            sample.values[n] = (uint64_t)((double)data[3 + order[n]] * scale);
+            sample.counted[n] = true;
+        }
+    }
+
+    void close()
+    {
+        for (int n = 0; n < EventCount; ++n) {
+            if (fds[n] >= 0) { ::close(fds[n]); }
+            fds[n] = -1;
+            order[n] = -1;
+        }
+        members = 0;
+    }
+#else
+    bool open()
+    {
+        error = "hardware counters are only supported on Linux";
+        return false;
+    }
+
+    void start() {}
+    void stop(Sample&) {}
+    void close() {}
+#endif
+};
+
+// runs fn once with the group counting, the wall time is always measured
+template <class Fn>
+static Sample measure(Group& group, Fn&& fn)
+{
+    Sample sample;
+    auto begin = Bench::Clock::now();
+    group.start();
+    fn();
+    group.stop(sample);
+    std::chrono::duration<double> elapsed = Bench::Clock::now() - begin;
+    sample.seconds = elapsed.count();
+    return sample;
+}
+
+static void print_header()
+{
+    std::printf("%-22s %10s %8s %8s %6s %9s %9s %9s\n",
+                "phase (per unit)", "ns", "instr", "cycles", "IPC", "br-miss", "L1d-miss", "LLC-miss");
+}
+
+// one line per phase, every counter divided by the number of units (tokens, instructions...)
+static void print(const char* phase, Sample const& sample, double units)
+{
+    auto per = [&](Event event, char* text) {
+        if (sample.counted[event]) {
+            std::snprintf(text, 16, "%.3f", (double)sample.values[event] / units);
+        }
+        else {
+            std::snprintf(text, 16, "-");
+        }
+    };
+
+    char instructions[16], cycles[16], misses[16], l1d[16], llc[16], ipc[16];
+    per(Instructions, instructions);
+    per(Cycles, cycles);
+    per(BranchMisses, misses);
+    per(L1DMisses, l1d);
+    per(LLCMisses, llc);
+    if (sample.counted[Instructions] && sample.counted[Cycles] && sample.values[Cycles] > 0) {
+        std::snprintf(ipc, sizeof(ipc), "%.2f", (double)sample.values[Instructions] / (double)sample.values[Cycles]);
+    }
+    else {
+        std::snprintf(ipc, sizeof(ipc), "-");
+    }
+
+    std::printf("%-22s %10.3f %8s %8s %6s %9s %9s %9s\n",
+                phase, sample.seconds * 1e9 / units, instructions, cycles, ipc, misses, l1d, llc);
+}
+
+}
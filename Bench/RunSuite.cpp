@@ -0,0 +1,55 @@
+// Benchmark suite: VM execution in executed instructions. Every workload is
+// compiled once and every chunk is run 'iterations' times by its own VM. See Suite.h.
+//
+//   cmake -S .. -B build && cmake --build build --target bench_run
+//   build/bench_run --size=262144 --json=run.json
+
+#include "Suite.h"
+
+static std::size_t count_instructions(ChunkView const& chunk)
+{
+    std::size_t count = 0;
+    for (Index offset = 0; offset < chunk.code_size; offset += 1 + op_info(chunk.code[offset]).operands) {
+        count++;
+    }
+    return count;
+}
+
+int main(int argc, const char** argv)
+{
+    const int iterations = 50;
+
+    Bench::Report report;
+    report.suite = "run";
+    report.unit = "instruction";
+    report.options = Bench::parse_options(argc, argv, 256 << 10);
+
+    Compiler compiler;
+    compiler.opt_level = report.options.opt_level;
+
+    for (auto const& workload : Bench::workloads(report.options.size)) {
+        std::vector<VM> vms(workload.scripts.size());
+        std::size_t instructions = 0;
+        for (std::size_t n = 0; n < vms.size(); ++n) {
+            vms[n].chunk = compiler.compile(workload.scripts[n]);
+            vms[n].load(*vms[n].chunk);
+            instructions += count_instructions(*vms[n].chunk);
+        }
+
+        double checksum = 0;
+        double seconds = Bench::best_of(report.options.runs, [&] {
+            checksum = 0;
+            for (int i = 0; i < iterations; ++i) {
+                for (auto& vm : vms) {
+                    vm.ip = vm.program.code;
+                    vm.reset_stack();
+                    vm.run();
+                    checksum += AS_NUMBER(vm.result);
+                }
+            }
+        });
+        report.add({ workload.name, workload.bytes, (double)instructions * iterations, seconds, checksum / iterations });
+    }
+
+    return report.write() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,43 @@
+// Benchmark suite: scanner throughput in tokens, on the compilable workloads and
+// on the generated lexer input (strings, comments, keywords). See Suite.h.
+//
+//   cmake -S .. -B build && cmake --build build --target bench_scan
+//   build/bench_scan --size=8388608 --json=scan.json
+
+#include "Suite.h"
+
+static Bench::Result scan(std::string const& name, std::vector<std::string> const& scripts, std::size_t bytes, int runs)
+{
+    std::size_t tokens = 0;
+    double checksum = 0;
+    double seconds = Bench::best_of(runs, [&] {
+        tokens = 0;
+        checksum = 0;
+        for (auto const& script : scripts) {
+            Scanner scanner(script.data(), (Size)script.size());
+            forever {
+                Token token = scanner.scan_token();
+                ++tokens;
+                checksum += token.length;
+                if (token.type == Token::Eof) { break; }
+            }
+        }
+    });
+    return { name, bytes, (double)tokens, seconds, checksum };
+}
+
+int main(int argc, const char** argv)
+{
+    Bench::Report report;
+    report.suite = "scan";
+    report.unit = "token";
+    report.options = Bench::parse_options(argc, argv, 8 << 20);
+
+    for (auto const& workload : Bench::workloads(report.options.size)) {
+        report.add(scan(workload.name, workload.scripts, workload.bytes, report.options.runs));
+    }
+    std::string lexer = Bench::lexer_script(report.options.size, 1);
+    report.add(scan("lexer", { lexer }, lexer.size(), report.options.runs));
+
+    return report.write() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,45 @@
+// Scanner throughput benchmark.
+//
+// Scans a generated multi-megabyte script and reports tokens/sec. Build it once with
+// the vector loops, once with AVX2 and once with the scalar table loops and compare:
+//
+//   g++ -std=c++17 -O2 -I.. ScannerBench.cpp -o scanner_sse2
+//   g++ -std=c++17 -O2 -I.. -mavx2 ScannerBench.cpp -o scanner_avx2
+//   g++ -std=c++17 -O2 -I.. -DNO_SIMD_SCANNER ScannerBench.cpp -o scanner_scalar
+
+#include <cstdlib>
+
+#include "Bench.h"
+#include "../Scanner.h"
+
+int main(int argc, const char** argv)
+{
+    const std::size_t megabytes = (argc > 1) ? std::atoi(argv[1]) : 16;
+    const std::string src = Bench::lexer_script(megabytes << 20, 1);
+
+    std::size_t tokens = 0;
+    double seconds = Bench::best_of(5, [&] {
+        Scanner scanner(src.data(), (int)src.size());
+        tokens = 0;
+        forever {
+            Token token = scanner.scan_token();
+            ++tokens;
+            if (token.type == Token::Eof) { break; }
+        }
+    });
+
+#if !defined(SIMD_SCANNER)
+    const char* loops = "scalar";
+#elif defined(__AVX2__)
+    const char* loops = "avx2";
+#else
+    const char* loops = "sse2";
+#endif
+
+    std::printf("scanner loops    : %s\n", loops);
+    std::printf("input            : %zu bytes\n", src.size());
+    std::printf("tokens           : %zu\n", tokens);
+    std::printf("time             : %.3f ms\n", seconds * 1e3);
+    std::printf("throughput       : %.1f Mtokens/s, %.1f MB/s\n", tokens / seconds / 1e6, src.size() / seconds / 1e6);
+    return 0;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+// Shared parts of the benchmark suite (ScanSuite, CompileSuite, RunSuite): the
+// generated workloads, the command line and the JSON report. The corpora only
+// depend on the size and fixed seeds, so results of two builds are comparable.
+//
+// options: --size=<source bytes per workload> --runs=<best of n> --json=<file> -O<level>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Bench.h"
+#include "../VM.h"
+
+namespace Bench {
+
+struct Options {
+    std::size_t size = 0;
+    int runs = 5;
+    int opt_level = 0;
+    std::string json; // empty: print the report to stdout
+};
+
+static Options parse_options(int argc, const char** argv, std::size_t default_size)
+{
+    Options options;
+    options.size = default_size;
+    for (int n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        if (std::strncmp(arg, "--size=", 7) == 0)      { options.size = std::strtoull(arg + 7, nullptr, 10); }
+        else if (std::strncmp(arg, "--runs=", 7) == 0) { options.runs = std::atoi(arg + 7); }
+        else if (std::strncmp(arg, "--json=", 7) == 0) { options.json = arg + 7; }
+        else if (std::strncmp(arg, "-O", 2) == 0)      { options.opt_level = std::atoi(arg + 2); }
+        else {
+            std::fprintf(stderr, "unknown option '%s'\n"
+                "usage: %s [--size=<bytes>] [--runs=<n>] [--json=<file>] [-O<level>]\n", arg, argv[0]);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    if (options.runs < 1) { options.runs = 1; }
+    return options;
+}
+
+struct Workload {
+    std::string name;
+    std::vector<std::string> scripts;
+    std::size_t bytes = 0;
+
+    void add(std::string script)
+    {
+        bytes += script.size();
+        scripts.push_back(std::move(script));
+    }
+};
+
+// the compilable workloads, each about 'size' bytes of source split into scripts
+static std::vector<Workload> workloads(std::size_t size)
+{
+    std::vector<Workload> all(3);
+    all[0].name = "arithmetic";
+    all[1].name = "nesting";
+    all[2].name = "constants";
+
+    for (unsigned seed = 0; all[0].bytes < size; ++seed) { all[0].add(arithmetic_script(500, seed)); }
+    for (unsigned seed = 0; all[1].bytes < size; ++seed) { all[1].add(nested_script(128, 16, seed)); }
+    for (unsigned seed = 0; all[2].bytes < size; ++seed) { all[2].add(constant_pool_script(4096, seed)); }
+    return all;
+}
+
+struct Result {
+    std::string workload;
+    std::size_t input_bytes;
+    double units; // tokens, source bytes, instructions...
+    double seconds; // best run
+    double checksum; // has to match between builds
+};
+
+struct Report {
+    std::string suite;
+    std::string unit;
+    Options options;
+    std::vector<Result> results;
+
+    void add(Result const& result)
+    {
+        results.push_back(result);
+        std::fprintf(stderr, "%-12s %-12s %12.0f %-12s %10.3f ms %8.3f ns/%s\n", suite.c_str(), result.workload.c_str(),
+                     result.units, unit.c_str(), result.seconds * 1e3, result.seconds * 1e9 / result.units, unit.c_str());
+    }
+
+    static const char* config_value()
+    {
+#if defined(NAN_BOXING)
+        return "nan-boxing";
+#else
+        return "variant";
+#endif
+    }
+
+    static const char* config_dispatch()
+    {
+#if defined(COMPUTED_GOTO)
+        return "computed-goto";
+#else
+        return "switch";
+#endif
+    }
+
+    static const char* config_scanner()
+    {
+#if !defined(SIMD_SCANNER)
+        return "scalar";
+#elif defined(__AVX2__)
+        return "avx2";
+#else
+        return "sse2";
+#endif
+    }
+
+    bool write() const
+    {
+        std::FILE* file = options.json.empty() ? stdout : std::fopen(options.json.c_str(), "w");
+        if (file == nullptr) {
+            std::fprintf(stderr, "can't write '%s'\n", options.json.c_str());
+            return false;
+        }
+
+        std::fprintf(file, "{\n");
+        std::fprintf(file, "  \"suite\": \"%s\",\n", suite.c_str());
+        std::fprintf(file, "  \"config\": { \"value\": \"%s\", \"dispatch\": \"%s\", \"scanner\": \"%s\", \"opt_level\": %d },\n",
+                     config_value(), config_dispatch(), config_scanner(), options.opt_level);
+        std::fprintf(file, "  \"size\": %zu,\n  \"runs\": %d,\n  \"unit\": \"%s\",\n  \"results\": [", options.size, options.runs, unit.c_str());
+        for (std::size_t n = 0; n < results.size(); ++n) {
+            Result const& r = results[n];
+            std::fprintf(file, "%s\n    { \"workload\": \"%s\", \"input_bytes\": %zu, \"units\": %.0f, \"best_ms\": %.3f, "
+                         "\"ns_per_unit\": %.4f, \"units_per_second\": %.0f, \"checksum\": %.17g }",
+                         n > 0 ? "," : "", r.workload.c_str(), r.input_bytes, r.units, r.seconds * 1e3,
+                         r.seconds * 1e9 / r.units, r.units / r.seconds, r.checksum);
+        }
+        std::fprintf(file, "\n  ]\n}\n");
+
+        return file == stdout ? std::fflush(stdout) == 0 : std::fclose(file) == 0;
+    }
+};
+
+}
@@ -0,0 +1,87 @@
+// Stack vs register tier benchmark.
+//
+// Compiles the suite workloads (see Suite.h) for both instruction formats: the
+// stack byte code as the interpreter runs it (superinstructions, unchecked
+// arithmetic, -O<level>) and the register tier (see RegisterCode.h). Straight line
+// code runs every instruction once, so the instruction counts are also the
+// dispatches per run. Both tiers have to compute the same results.
+//
+//   cmake -S .. -B build && cmake --build build --target tier_bench
+//   build/tier_bench --size=262144
+
+#include "Suite.h"
+
+static std::size_t count_instructions(ChunkView const& chunk)
+{
+    std::size_t count = 0;
+    for (Index offset = 0; offset < chunk.code_size; offset += 1 + op_info(chunk.code[offset]).operands) {
+        count++;
+    }
+    return count;
+}
+
+struct Tier {
+    std::size_t instructions = 0;
+    std::size_t code_bytes = 0;
+    double seconds = 0;
+    double checksum = 0;
+};
+
+int main(int argc, const char** argv)
+{
+    const int iterations = 50;
+    Bench::Options options = Bench::parse_options(argc, argv, 256 << 10);
+
+    Compiler compiler;
+    compiler.opt_level = options.opt_level;
+
+    bool same = true;
+    std::printf("%-12s %10s %10s %10s %10s %10s %10s %8s\n", "workload", "stack ins", "reg ins",
+                "stack KB", "reg KB", "stack ms", "reg ms", "speedup");
+    for (auto const& workload : Bench::workloads(options.size)) {
+        Tier stack, registers;
+
+        std::vector<VM> vms(workload.scripts.size());
+        std::vector<RegisterChunk> codes(workload.scripts.size());
+        for (std::size_t n = 0; n < vms.size(); ++n) {
+            vms[n].chunk = compiler.compile(workload.scripts[n]);
+            vms[n].load(*vms[n].chunk);
+            stack.instructions += count_instructions(*vms[n].chunk);
+            stack.code_bytes += vms[n].chunk->code.size();
+
+            compiler.compile(workload.scripts[n], codes[n]);
+            registers.instructions += codes[n].code.size();
+            registers.code_bytes += codes[n].code.size() * sizeof(RegInstr);
+        }
+
+        stack.seconds = Bench::best_of(options.runs, [&] {
+            stack.checksum = 0;
+            for (int i = 0; i < iterations; ++i) {
+                for (auto& vm : vms) {
+                    vm.ip = vm.program.code;
+                    vm.reset_stack();
+                    vm.run();
+                    stack.checksum += AS_NUMBER(vm.result);
+                }
+            }
+        });
+
+        VM register_vm;
+        registers.seconds = Bench::best_of(options.runs, [&] {
+            registers.checksum = 0;
+            for (int i = 0; i < iterations; ++i) {
+                for (auto const& code : codes) {
+                    register_vm.run_registers(code);
+                    registers.checksum += AS_NUMBER(register_vm.result);
+                }
+            }
+        });
+
+        same = same && stack.checksum == registers.checksum;
+        std::printf("%-12s %10zu %10zu %10.1f %10.1f %10.3f %10.3f %8.2f%s\n", workload.name.c_str(),
+                    stack.instructions, registers.instructions, stack.code_bytes / 1024.0, registers.code_bytes / 1024.0,
+                    stack.seconds * 1e3, registers.seconds * 1e3, stack.seconds / registers.seconds,
+                    stack.checksum == registers.checksum ? "" : "  MISMATCH");
+    }
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
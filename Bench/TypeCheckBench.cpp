@@ -0,0 +1,99 @@
+// Type check elision benchmark.
+//
+// Compiles the suite workloads (see Suite.h) once with the operand checks and once
+// with the unchecked arithmetic the compiler can prove (see Types.h), counts the
+// operand checks left in the code and runs both. The results have to be identical.
+// Straight line code runs every instruction once, so the checks counted in the code
+// are the checks executed per run.
+//
+//   cmake -S .. -B build && cmake --build build --target type_check_bench
+//   build/type_check_bench --size=262144 -O1
+
+#include "Suite.h"
+
+// operands an instruction checks before it computes
+static int operand_checks(Byte op)
+{
+    if (is_unchecked(op) || op == OP_Negate_Const) { return 0; }
+    switch (generic_op(op)) {
+    case OP_Add:
+    case OP_Subtract:
+    case OP_Multiply:
+    case OP_Divide:
+        return 2;
+    case OP_Negate:
+    case OP_Add_Const:
+    case OP_Subtract_Const:
+    case OP_Multiply_Const:
+    case OP_Divide_Const:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static std::size_t count_checks(ChunkView const& chunk)
+{
+    std::size_t checks = 0;
+    for (Index offset = 0; offset < chunk.code_size; offset += 1 + op_info(chunk.code[offset]).operands) {
+        checks += operand_checks(chunk.code[offset]);
+    }
+    return checks;
+}
+
+struct Run {
+    std::size_t checks = 0;
+    double seconds = 0;
+    double checksum = 0;
+};
+
+static Run run(Compiler& compiler, Bench::Workload const& workload, int runs)
+{
+    const int iterations = 50;
+
+    Run result;
+    std::vector<VM> vms(workload.scripts.size());
+    for (std::size_t n = 0; n < vms.size(); ++n) {
+        vms[n].chunk = compiler.compile(workload.scripts[n]);
+        vms[n].load(*vms[n].chunk);
+        result.checks += count_checks(*vms[n].chunk);
+    }
+
+    result.seconds = Bench::best_of(runs, [&] {
+        result.checksum = 0;
+        for (int i = 0; i < iterations; ++i) {
+            for (auto& vm : vms) {
+                vm.ip = vm.program.code;
+                vm.reset_stack();
+                vm.run();
+                result.checksum += AS_NUMBER(vm.result);
+            }
+        }
+    });
+    return result;
+}
+
+int main(int argc, const char** argv)
+{
+    Bench::Options options = Bench::parse_options(argc, argv, 256 << 10);
+
+    Compiler checked;
+    checked.unchecked_arithmetic = false;
+    checked.opt_level = options.opt_level;
+    Compiler unchecked;
+    unchecked.opt_level = options.opt_level;
+
+    bool same = true;
+    std::printf("%-12s %12s %12s %9s %12s %12s %8s\n",
+                "workload", "checks", "unchecked", "removed", "checked ms", "unchecked ms", "speedup");
+    for (auto const& workload : Bench::workloads(options.size)) {
+        Run a = run(checked, workload, options.runs);
+        Run b = run(unchecked, workload, options.runs);
+        same = same && a.checksum == b.checksum;
+
+        std::printf("%-12s %12zu %12zu %8.1f%% %12.3f %12.3f %8.2f%s\n", workload.name.c_str(), a.checks, b.checks,
+                    a.checks ? 100.0 * (double)(a.checks - b.checks) / (double)a.checks : 0.0,
+                    a.seconds * 1e3, b.seconds * 1e3, a.seconds / b.seconds, a.checksum == b.checksum ? "" : "  MISMATCH");
+    }
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
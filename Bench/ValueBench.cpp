@@ -0,0 +1,96 @@
+// Value representation micro benchmark.
+//
+// Compiles a set of arithmetic heavy scripts and evaluates their chunks with the
+// same push/pop/IS_NUMBER/AS_NUMBER pattern VM::run uses, so only the cost of the
+// Value representation is measured. Build it once per representation and compare:
+//
+//   g++ -std=c++17 -O2 -I.. ValueBench.cpp -o value_variant
+//   g++ -std=c++17 -O2 -I.. -DNAN_BOXING ValueBench.cpp -o value_nanbox
+
+#include <vector>
+
+#include "Bench.h"
+#include "../Compiler.h"
+
+static bool eval(Chunk const& chunk, Values& stack, Number& result)
+{
+    std::size_t top = 0;
+    std::size_t ip = 0;
+
+    forever {
+        switch (chunk.code[ip++]) {
+        case OP_Constant:
+            stack[top++] = chunk.constants[chunk.code[ip++]];
+            break;
+
+#define BINARY_OP(op)                                                          \
+            if (!IS_NUMBER(stack[top - 1]) || !IS_NUMBER(stack[top - 2])) {    \
+                return false;                                                  \
+            }                                                                  \
+            stack[top - 2] = AS_NUMBER(stack[top - 2]) op AS_NUMBER(stack[top - 1]); \
+            --top;
+
+        case OP_Add:      { BINARY_OP(+); break; }
+        case OP_Subtract: { BINARY_OP(-); break; }
+        case OP_Multiply: { BINARY_OP(*); break; }
+        case OP_Divide:   { BINARY_OP(/); break; }
+#undef BINARY_OP
+
+        case OP_Negate:
+            if (!IS_NUMBER(stack[top - 1])) { return false; }
+            stack[top - 1] = -AS_NUMBER(stack[top - 1]);
+            break;
+
+        case OP_Return:
+            result = AS_NUMBER(stack[--top]);
+            return true;
+
+        default:
+            return false;
+        }
+    }
+}
+
+int main()
+{
+    const int scripts = 64;
+    const int terms = 200;
+    const int iterations = 2000;
+
+    Compiler compiler;
+    Chunks chunks(scripts);
+    std::size_t constants = 0;
+    std::size_t instructions = 0;
+    for (int n = 0; n < scripts; ++n) {
+        compiler.compile(Bench::arithmetic_script(terms, n), chunks[n]);
+        constants += chunks[n].constants.size();
+        instructions += chunks[n].code.size();
+    }
+
+    Values stack(1024);
+    Number checksum = 0;
+    double seconds = Bench::best_of(5, [&] {
+        for (int i = 0; i < iterations; ++i) {
+            for (auto const& chunk : chunks) {
+                Number result = 0;
+                eval(chunk, stack, result);
+                checksum += result;
+            }
+        }
+    });
+
+#if defined(NAN_BOXING)
+    const char* representation = "nan-boxing";
+#else
+    const char* representation = "std::variant";
+#endif
+
+    std::printf("representation   : %s\n", representation);
+    std::printf("sizeof(Value)    : %zu bytes\n", sizeof(Value));
+    std::printf("constant pools   : %zu bytes\n", constants * sizeof(Value));
+    std::printf("byte code        : %zu bytes\n", instructions);
+    std::printf("time             : %.3f ms\n", seconds * 1e3);
+    std::printf("per instruction  : %.2f ns\n", seconds * 1e9 / ((double)instructions * iterations));
+    std::printf("checksum         : %g\n", checksum);
+    return 0;
+}
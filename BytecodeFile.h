@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <new>
+#include <string>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Common.h"
+#include "Chunk.h"
+#include "MappedFile.h"
+#include "Verifier.h"
+
+// .loxc files: compiled chunks of a script, stored next to it, so later runs can skip
+// the scanner and the compiler. The file is mapped into memory and the VM runs the
+// code, constants and line runs right out of the mapping without copying them.
+//
+// layout (host byte order, every section 8 byte aligned):
+//   FileHeader
+//   per chunk: ChunkHeader, constants (Value[]), lines (LineRun[]), code (Byte[])
+//
+// Values are stored in their in-memory representation, that's why the header records
+// the representation and a file from a different build is treated as stale.
+namespace BytecodeFile {
+
+static const char     MAGIC[4] = { 'L', 'O', 'X', 'C' };
+static const uint32_t FORMAT_VERSION = 2;
+
+#if defined(NAN_BOXING)
+static const uint32_t VALUE_REPR = 1;
+#else
+static const uint32_t VALUE_REPR = 0;
+#endif
+
+struct FileHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t value_repr;
+    uint32_t value_size;
+    uint32_t opcode_count; // catches files from builds with a different instruction set
+    uint32_t opt_level;
+    uint64_t source_hash;
+    uint32_t chunk_count;
+    uint32_t code_flags; // Compiler::code_flags
+};
+
+struct ChunkHeader {
+    uint32_t code_size;
+    uint32_t constant_count;
+    uint32_t line_count;
+    uint32_t max_stack;
+};
+
+static std::size_t align8(std::size_t size)
+{
+    return (size + 7) & ~(std::size_t)7;
+}
+
+// foo.lox -> foo.loxc
+static std::string cache_path(std::string const& source_path)
+{
+    return source_path + "c";
+}
+
+// a mapped .loxc file, the views point into the mapping and are valid as long as the image lives
+struct Image {
+    MappedFile file;
+    std::vector<ChunkView> chunks;
+};
+
+// <path>.tmp.<pid>, where write() puts the file together
+static std::string temp_path(std::string const& path)
+{
+#if defined(_WIN32)
+    return path + ".tmp." + std::to_string(_getpid());
+#else
+    return path + ".tmp." + std::to_string(getpid());
+#endif
+}
+
+// Writes the whole file next to path and renames it over the old one, so a process
+// that still maps the old file keeps reading it and no one sees a half written one.
+static bool write(std::string const& path, Chunks const& chunks, uint64_t source_hash, int opt_level, uint32_t code_flags)
+{
+    const std::string temp = temp_path(path);
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) { return false; }
+
+    static const char padding[8] = {};
+    auto write_section = [&](const void* data, std::size_t size) {
+        file.write((const char*)data, size);
+        file.write(padding, align8(size) - size);
+    };
+
+    FileHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.value_repr = VALUE_REPR;
+    header.value_size = sizeof(Value);
+    header.opcode_count = OP_Count;
+    header.opt_level = (uint32_t)opt_level;
+    header.source_hash = source_hash;
+    header.chunk_count = (uint32_t)chunks.size();
+    header.code_flags = code_flags;
+    write_section(&header, sizeof(header));
+
+    for (auto const& chunk : chunks) {
+        ChunkHeader chunk_header = {};
+        chunk_header.code_size = (uint32_t)chunk.code.size();
+        chunk_header.constant_count = (uint32_t)chunk.constants.size();
+        chunk_header.line_count = (uint32_t)chunk.lines.size();
+        chunk_header.max_stack = (uint32_t)chunk.max_stack;
+
+        write_section(&chunk_header, sizeof(chunk_header));
+        // built in zeroed bytes from the active alternative only, copying a variant copies
+        // its padding and whatever a larger alternative left there, the files should only
+        // depend on the values
+        for (Value const& constant : chunk.constants) {
+            alignas(Value) Byte bytes[sizeof(Value)] = {};
+#if defined(NAN_BOXING)
+            std::memcpy(bytes, &constant, sizeof(Value)); // one word, every bit is the value
+#else
+            std::visit([&](auto const& alternative) { new (bytes) Value(alternative); }, constant);
+#endif
+            file.write((const char*)bytes, sizeof(bytes));
+        }
+        file.write(padding, align8(chunk.constants.size() * sizeof(Value)) - chunk.constants.size() * sizeof(Value));
+        write_section(chunk.lines.data(), chunk.lines.size() * sizeof(LineRun));
+        write_section(chunk.code.data(), chunk.code.size());
+    }
+
+    file.close();
+    if (!file) {
+        std::remove(temp.c_str());
+        return false;
+    }
+#if defined(_WIN32)
+    std::remove(path.c_str()); // rename doesn't replace files there, they aren't mapped either
+#endif
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// maps the file, checks it belongs to this source and this build and verifies the
+// chunks, false means the cache is missing, stale or broken and the script has to be compiled
+static bool load(std::string const& path, uint64_t source_hash, int opt_level, uint32_t code_flags, Image& image)
+{
+    image.chunks.clear();
+    if (!image.file.open(path)) { return false; }
+
+    const Byte* at = image.file.data;
+    const Byte* end = at + image.file.size;
+    auto take = [&](std::size_t size) -> const Byte* {
+        if ((std::size_t)(end - at) < align8(size)) { return nullptr; }
+        const Byte* section = at;
+        at += align8(size);
+        return section;
+    };
+
+    auto header = (const FileHeader*)take(sizeof(FileHeader));
+    if (header == nullptr
+        || std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0
+        || header->version != FORMAT_VERSION
+        || header->value_repr != VALUE_REPR
+        || header->value_size != sizeof(Value)
+        || header->opcode_count != OP_Count
+        || header->opt_level != (uint32_t)opt_level
+        || header->code_flags != code_flags
+        || header->source_hash != source_hash) {
+        return false;
+    }
+
+    for (uint32_t n = 0; n < header->chunk_count; ++n) {
+        auto chunk_header = (const ChunkHeader*)take(sizeof(ChunkHeader));
+        if (chunk_header == nullptr) { return false; }
+
+        ChunkView view;
+        view.constants = (const Value*)take(chunk_header->constant_count * sizeof(Value));
+        view.lines = (const LineRun*)take(chunk_header->line_count * sizeof(LineRun));
+        view.code = take(chunk_header->code_size);
+        if (view.constants == nullptr || view.lines == nullptr || view.code == nullptr) {
+            return false;
+        }
+
+        view.constant_count = (Size)chunk_header->constant_count;
+        view.line_count = (Size)chunk_header->line_count;
+        view.code_size = (Size)chunk_header->code_size;
+        view.max_stack = (Size)chunk_header->max_stack;
+        if (!Verifier::verify(view)) { return false; } // once here, not on every run
+        view.verified = true;
+        image.chunks.push_back(view);
+    }
+
+    return true;
+}
+
+}
@@ -1,23 +1,83 @@
 #pragma once
 
 
+#include <algorithm>
+#include <unordered_map>
+
 #include "Common.h"
+#include "OpCodes.h"
 #include "Value.h"
 
+// line information, run length encoded: every byte from offset up to the
+// offset of the next run belongs to line
+struct LineRun {
+    Index offset;
+    Index line;
+};
+using LineRuns = std::vector<LineRun>;
+
+struct Chunk;
+
+// read-only window onto compiled code, the VM only runs these, so it doesn't care
+// if the bytes live in a Chunk or in a mapped .loxc file (see BytecodeFile.h)
+struct ChunkView {
+    const Byte* code = nullptr;
+    Size code_size = 0;
+    const Value* constants = nullptr;
+    Size constant_count = 0;
+    const LineRun* lines = nullptr;
+    Size line_count = 0;
+    Size max_stack = 0;
+    bool verified = false; // Verifier::verify accepted it, loading it doesn't check again
+
+    ChunkView() = default;
+    ChunkView(Chunk const& chunk);
+
+    // source line of the byte at offset, binary search over the runs (only needed for errors and debug output)
+    Index line_at(Index offset) const
+    {
+        auto after = std::upper_bound(lines, lines + line_count, offset, [](Index o, LineRun const& run) {
+            return o < run.offset;
+        });
+        assert(after != lines);
+        return (after - 1)->line;
+    }
+
+    // constant index used by the OP_Constant / OP_Constant_Long at offset
+    Index constant_index(Index offset) const
+    {
+        if (op_info(code[offset]).operands == 1) {
+            return code[offset + 1];
+        }
+        return code[offset + 1] | (code[offset + 2] << 8) | (code[offset + 3] << 16);
+    }
+};
+
 // chunk := simple dynamic array
 struct Chunk {
 
     Bytes code; // byte code
-    Indices lines; // line information
+    LineRuns lines; // line information, use line_at()
     Values constants;
+    std::unordered_map<Value, Index, ValueHash, ValueIdentical> constant_indices; // every constant is stored once
+    Size max_stack = 0; // deepest value stack the code needs, computed while compiling
+    bool verified = false; // see ChunkView, every change clears it (code edited by hand has to as well)
 
     Chunk() = default;
 
     void write(Byte byte, Index line)
     {
-        // append the new byte to the list
+        verified = false;
+        // append the new byte to the list, a new line starts a new run
+        if (lines.empty() || lines.back().line != line) {
+            lines.push_back({ (Index)code.size(), line });
+        }
         code.push_back(byte);
-        lines.push_back(line);
+    }
+
+    Index line_at(Index offset) const
+    {
+        return ChunkView(*this).line_at(offset);
     }
 
     void clear()
@@ -25,14 +85,73 @@ struct Chunk {
         code.clear();
         lines.clear();
         constants.clear();
+        constant_indices.clear();
+        max_stack = 0;
+        verified = false;
     }
 
+    // returns the index of the value in the constant pool, adds it if it's new
     Index add_const(Value value)
     {
+        auto found = constant_indices.find(value);
+        if (found != constant_indices.end()) {
+            return found->second;
+        }
+
         constants.push_back(value);
-        return constants.size() - 1;
+        Index index = (Index)constants.size() - 1;
+        constant_indices.emplace(value, index);
+        return index;
+    }
+
+    // OP_Constant for the first 256 constants, OP_Constant_Long after that
+    void write_constant(Index constant, Index line)
+    {
+        if (constant <= UINT8_MAX) {
+            write(OP_Constant, line);
+            write((Byte)constant, line);
+            return;
+        }
+
+        write(OP_Constant_Long, line);
+        write((Byte)(constant & 0xff), line);
+        write((Byte)((constant >> 8) & 0xff), line);
+        write((Byte)((constant >> 16) & 0xff), line);
+    }
+
+    Index constant_index(Index offset) const
+    {
+        return ChunkView(*this).constant_index(offset);
+    }
+
+    // Peephole for superinstructions: op, about to be written right after the
+    // OP_Constant at offset (the last instruction), is fused into that constant.
+    // Only number constants are fused, so the VM just has to check the other operand.
+    bool fuse(Index offset, OpCode op)
+    {
+        Byte fused = fused_op(op);
+        if (fused == 0 || offset < 0 || offset + 2 != (Index)code.size() || code[offset] != OP_Constant
+            || !IS_NUMBER(constants[code[offset + 1]])) {
+            return false;
+        }
+
+        code[offset] = fused;
+        verified = false;
+        return true;
     }
 };
 
+inline ChunkView::ChunkView(Chunk const& chunk)
+    : code(chunk.code.data())
+    , code_size((Size)chunk.code.size())
+    , constants(chunk.constants.data())
+    , constant_count((Size)chunk.constants.size())
+    , lines(chunk.lines.data())
+    , line_count((Size)chunk.lines.size())
+    , max_stack(chunk.max_stack)
+    , verified(chunk.verified)
+{
+}
+
 
 using Chunks = std::vector<Chunk>;
\ No newline at end of file
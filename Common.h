@@ -9,9 +9,47 @@
 
 #define forever for (;;)
 
+// build configuration, pass these as compiler flags (-D / <PreprocessorDefinitions>)
+// NAN_BOXING            -> store a Value in a single 64-bit word instead of a std::variant
+// DEBUG_TRACE_EXECUTION -> dump the value stack before every instruction (on in debug builds)
+// DEBUG_PRINT_CODE      -> disassemble every compiled chunk, before and after optimizing (on in debug builds)
+// NO_COMPUTED_GOTO      -> force the portable switch dispatch in VM::run
+// PROFILE_OPCODES       -> count executions and cycles per opcode and source line, see Profiler.h
+// NO_JIT                -> leave out the x86-64 JIT for hot chunks, see Jit.h
+
+#if defined(_DEBUG) || defined(DEBUG)
+#define DEBUG_TRACE_EXECUTION
+#define DEBUG_PRINT_CODE
+#endif
+
+// labels as values is a GCC/Clang extension, MSVC always uses the switch
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(NO_COMPUTED_GOTO)
+#define COMPUTED_GOTO
+#endif
+
+// lets the optimizer rely on a condition that was proven elsewhere (by the verifier)
+#if defined(_MSC_VER)
+#define ASSUME(cond) __assume(cond)
+#elif defined(__GNUC__) || defined(__clang__)
+#define ASSUME(cond) do { if (!(cond)) { __builtin_unreachable(); } } while (false)
+#else
+#define ASSUME(cond) ((void)0)
+#endif
+
 using Byte   = uint8_t;
 using Size   = int;
 using Index  = int;
 
 using Bytes   = std::vector<Byte>;
-using Indices = std::vector<Index>;
\ No newline at end of file
+using Indices = std::vector<Index>;
+
+// FNV-1a, used to recognize source code that was compiled before
+static inline uint64_t hash_source(const char* data, std::size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (std::size_t n = 0; n < size; ++n) {
+        hash ^= (Byte)data[n];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
\ No newline at end of file
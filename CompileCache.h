@@ -0,0 +1,113 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "Common.h"
+#include "Chunk.h"
+#include "Compiler.h"
+
+// LRU cache of compiled chunks keyed by the hash of their source, so hosts and the
+// REPL that evaluate the same expressions over and over only compile them once.
+// Every entry keeps its source text, a hash collision is a miss and never runs
+// the wrong code. The memory bound covers the sources and the chunks.
+struct CompileCache {
+
+    struct Entry {
+        uint64_t hash;
+        std::string source;
+        int opt_level;
+        uint32_t code_flags; // Compiler::code_flags
+        ChunkRef chunk;
+        std::size_t bytes;
+    };
+    using Entries = std::list<Entry>; // most recently used first
+
+    Entries entries;
+    std::unordered_map<uint64_t, Entries::iterator> index;
+    std::size_t max_bytes;
+    std::size_t bytes = 0;
+
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t evictions = 0;
+
+    explicit CompileCache(std::size_t max_bytes = 1 << 20) : max_bytes(max_bytes) {}
+
+    // null on a miss
+    ChunkRef find(const char* src, Size length, int opt_level, uint32_t code_flags)
+    {
+        auto found = index.find(hash_source(src, length));
+        if (found == index.end()
+            || found->second->opt_level != opt_level
+            || found->second->code_flags != code_flags
+            || found->second->source.compare(0, std::string::npos, src, length) != 0) {
+            misses++;
+            return nullptr;
+        }
+
+        hits++;
+        entries.splice(entries.begin(), entries, found->second);
+        return found->second->chunk;
+    }
+
+    void insert(const char* src, Size length, int opt_level, uint32_t code_flags, ChunkRef chunk)
+    {
+        uint64_t hash = hash_source(src, length);
+        auto found = index.find(hash);
+        if (found != index.end()) {
+            remove(found->second);
+        }
+
+        std::size_t size = entry_bytes(length, *chunk);
+        if (size > max_bytes) { return; }
+
+        entries.push_front(Entry{ hash, std::string(src, length), opt_level, code_flags, std::move(chunk), size });
+        index[hash] = entries.begin();
+        bytes += size;
+
+        while (bytes > max_bytes) {
+            remove(std::prev(entries.end()));
+            evictions++;
+        }
+    }
+
+    // compile through the cache, compile errors aren't cached so they get reported every time
+    ChunkRef compile(Compiler& compiler, const char* src, Size length)
+    {
+        ChunkRef chunk = find(src, length, compiler.opt_level, compiler.code_flags());
+        if (chunk == nullptr) {
+            chunk = compiler.compile(src, length);
+            if (chunk != nullptr) {
+                insert(src, length, compiler.opt_level, compiler.code_flags(), chunk);
+            }
+        }
+        return chunk;
+    }
+
+    void clear()
+    {
+        entries.clear();
+        index.clear();
+        bytes = 0;
+    }
+
+    void remove(Entries::iterator entry)
+    {
+        bytes -= entry->bytes;
+        index.erase(entry->hash);
+        entries.erase(entry);
+    }
+
+    // rough heap footprint of an entry
+    static std::size_t entry_bytes(Size source_length, Chunk const& chunk)
+    {
+        return sizeof(Entry) + sizeof(Chunk)
+            + (std::size_t)source_length
+            + chunk.code.capacity()
+            + chunk.constants.capacity() * sizeof(Value)
+            + chunk.lines.capacity() * sizeof(LineRun)
+            + chunk.constant_indices.size() * (sizeof(Value) + sizeof(Index) + 2 * sizeof(void*));
+    }
+};
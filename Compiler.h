@@ -0,0 +1,499 @@
+#pragma once
+
+#include <memory>
+
+#include "Common.h"
+#include "Chunk.h"
+#include "Debug.h"
+#include "Optimizer.h"
+#include "ParallelLexer.h"
+#include "RegisterCode.h"
+#include "Scanner.h"
+#include "Ssa.h"
+#include "OpCodes.h"
+#include "Token.h"
+#include "Types.h"
+#include "Value.h"
+#include "Verifier.h"
+
+// Compiled code is immutable once the compiler hands it out, any number of VMs
+// (on any number of threads) can run the same chunk at once without copying it.
+using ChunkRef = std::shared_ptr<const Chunk>;
+
+struct Parser {
+    Token current;
+    Token previous;
+    bool error_raised = false;
+    bool panic_raised = false; // used instead of exceptions to unwind the whole stack
+
+    Parser() = default;
+};
+
+enum class Precedence {
+    None,
+    Assignment,  // =
+    Or,          // or
+    And,         // and
+    Equality,    // == !=
+    Comparison,  // < > <= >=
+    Term,        // + -
+    Factor,      // * /
+    Unary,       // ! - +
+    Call,        // . () []
+    Primary
+};
+
+
+
+// single pass compiler: source -> Chunk, owns all the parsing state
+struct Compiler {
+
+    using Prec = Precedence; // just for a little less typing
+    typedef void (Compiler::*ParseFn)(); /// change to either 'using' or std::function ...
+
+    struct ParseRule {
+        ParseFn prefix;
+        ParseFn infix;
+        Precedence precedence;
+    };
+    using ParseRules = std::vector<ParseRule>;
+
+    ParseRules rules = {
+        { &Compiler::grouping,  nullptr,            Prec::Call },        // TOKEN_LEFT_PAREN
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_RIGHT_PAREN
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_LEFT_BRACE
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_RIGHT_BRACE
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_COMMA
+        { nullptr,              nullptr,            Prec::Call },        // TOKEN_DOT
+        { &Compiler::unary,     &Compiler::binary,  Prec::Term },        // TOKEN_MINUS
+        { nullptr,              &Compiler::binary,  Prec::Term },        // TOKEN_PLUS
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_SEMICOLON
+        { nullptr,              &Compiler::binary,  Prec::Factor },      // TOKEN_SLASH
+        { nullptr,              &Compiler::binary,  Prec::Factor },      // TOKEN_STAR
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_BANG
+        { nullptr,              nullptr,            Prec::Equality },    // TOKEN_BANG_EQUAL
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_EQUAL
+        { nullptr,              nullptr,            Prec::Equality },    // TOKEN_EQUAL_EQUAL
+        { nullptr,              nullptr,            Prec::Comparison },  // TOKEN_GREATER
+        { nullptr,              nullptr,            Prec::Comparison },  // TOKEN_GREATER_EQUAL
+        { nullptr,              nullptr,            Prec::Comparison },  // TOKEN_LESS
+        { nullptr,              nullptr,            Prec::Comparison },  // TOKEN_LESS_EQUAL
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_IDENTIFIER
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_STRING
+        { &Compiler::number,    nullptr,            Prec::None },        // TOKEN_NUMBER
+        { nullptr,              nullptr,            Prec::And },         // TOKEN_AND
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_CLASS
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_ELSE
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_FALSE
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_FUN
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_FOR
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_IF
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_NIL
+        { nullptr,              nullptr,            Prec::Or },          // TOKEN_OR
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_PRINT
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_RETURN
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_SUPER
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_THIS
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_TRUE
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_VAR
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_WHILE
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_ERROR
+        { nullptr,              nullptr,            Prec::None },        // TOKEN_EOF
+    };
+
+
+    Chunk* compiling_chunk = nullptr;
+    Size compiling_depth = 0; // stack depth at the current emit position
+    Index last_instruction = -1; // offset of the last instruction emitted
+    int opt_level = 0; // -O level, see Optimizer.h
+    bool superinstructions = true; // fuse constants with the next instruction, see Chunk::fuse
+    int lex_threads = 1; // large sources are tokenized on this many threads, see ParallelLexer.h
+    bool unchecked_arithmetic = true; // skip the operand checks the types prove, see Types.h
+    StaticType expression_type = StaticType::Unknown; // of the expression parsed last
+    RegisterChunk* compiling_registers = nullptr; // set while compiling for the register tier
+    RegisterEmitter register_emitter;
+    Operand operand; // register tier: where the value of the expression parsed last is
+    std::unique_ptr<Scanner> scanner;
+    std::vector<StaticType> verify_types; // scratch space of Verifier::verify
+
+    Parser parser;
+
+    Compiler() = default;
+
+    // the settings besides opt_level that change the compiled code, cached code has to match them
+    enum CodeFlags : uint32_t {
+        CODE_SUPERINSTRUCTIONS = 1 << 0,
+        CODE_UNCHECKED = 1 << 1,
+    };
+
+    uint32_t code_flags() const
+    {
+        return (superinstructions ? (uint32_t)CODE_SUPERINSTRUCTIONS : 0u) | (unchecked_arithmetic ? (uint32_t)CODE_UNCHECKED : 0u);
+    }
+
+    ChunkRef compile(std::string const& src)
+    {
+        return compile(src.data(), (Size)src.size());
+    }
+
+    // compiles, optimizes and verifies a whole script, null on a compile error;
+    // VMs and caches run the chunk without verifying it again
+    ChunkRef compile(const char* src, Size length)
+    {
+        auto chunk = std::make_shared<Chunk>();
+        if (!compile(src, length, *chunk)) {
+            return nullptr;
+        }
+
+        optimize(*chunk);
+        if (!Verifier::verify(*chunk, verify_types)) {
+            return nullptr;
+        }
+        chunk->verified = true;
+        return chunk;
+    }
+
+    void optimize(Chunk& c) const
+    {
+#if defined(DEBUG_PRINT_CODE)
+        Debug::show(c, "code");
+#endif
+        if (opt_level < 1) { return; }
+
+        if (opt_level >= 2) {
+            Ssa::Function ir = Ssa::lift(c);
+            Ssa::optimize(ir);
+#if defined(DEBUG_PRINT_CODE)
+            Ssa::show(ir, "IR after -O2");
+#endif
+            Ssa::lower(ir, c, superinstructions);
+        }
+        else {
+            Optimizer::optimize(c, opt_level, superinstructions);
+        }
+
+#if defined(DEBUG_PRINT_CODE)
+        char title[32];
+        std::snprintf(title, sizeof(title), "code after -O%d", opt_level);
+        Debug::show(c, title);
+#endif
+    }
+
+    bool compile(std::string const& src, Chunk& chunk)
+    {
+        return compile(src.data(), (Size)src.size(), chunk);
+    }
+
+    bool compile(const char* src, Size length, Chunk& chunk)
+    {
+        compiling_chunk = &chunk;
+        compiling_depth = 0;
+        last_instruction = -1;
+        return compile_script(src, length);
+    }
+
+    bool compile(std::string const& src, RegisterChunk& code)
+    {
+        return compile(src.data(), (Size)src.size(), code);
+    }
+
+    // the same script for the register tier, see RegisterCode.h (not optimized)
+    bool compile(const char* src, Size length, RegisterChunk& code)
+    {
+        compiling_chunk = nullptr;
+        compiling_registers = &code;
+        register_emitter.start(code);
+        bool compiled = compile_script(src, length);
+        compiling_registers = nullptr;
+        return compiled;
+    }
+
+    // A script is a sequence of expressions separated by ';', a ';' after the
+    // last one is optional. Every expression but the last is printed, the last
+    // one is returned.
+    // The source doesn't have to be zero terminated, tokens point into it.
+    bool compile_script(const char* src, Size length)
+    {
+        scanner = std::make_unique<Scanner>(src, length);
+        if (lex_threads > 1 && length >= 2 * ParallelLexer::MIN_PIECE) {
+            ParallelLexer::scan(*scanner, lex_threads);
+        }
+        parser = Parser{};
+
+        advance();
+        forever {
+            expression();
+            if (parser.current.type != Token::Eof && !parser.error_raised) {
+                consume(Token::Semicolon, "Expected ';' after expression.");
+            }
+            while (parser.current.type == Token::Semicolon) { advance(); }
+
+            if (parser.current.type == Token::Eof || parser.error_raised) { break; }
+            emit_print();
+        }
+        consume(Token::Eof, "Expected EoF token!");
+        end_compiler();
+
+        return !parser.error_raised;
+    }
+
+    void advance()
+    {
+        parser.previous = parser.current;
+
+        forever {
+            parser.current = scanner->scan_token();
+            if (parser.current.type != Token::Error) { break; }
+
+            error_at_current(Scanner::message(parser.current));
+        }
+    }
+
+    void error_at_current(const char* msg)
+    {
+        error_at(&parser.current, msg);
+    }
+
+    void error(const char* msg)
+    {
+        error_at(&parser.previous, msg);
+    }
+
+    void error_at(Token* token, const char* msg)
+    {
+        if (parser.panic_raised) { return; }
+        parser.panic_raised = true;
+
+        std::fprintf(stderr, "[line %d] Error", scanner->line_of(*token));
+
+        if (token->type == Token::Eof) {
+            std::fprintf(stderr, " at end");
+        }
+        else if (token->type == Token::Error) {
+            // Nothing.
+        }
+        else {
+            std::fprintf(stderr, " at '%.*s'", (int)token->length, scanner->lexeme(*token));
+        }
+
+        std::fprintf(stderr, ": %s\n", msg);
+        parser.error_raised = true;
+    }
+
+    void consume(Token::Type type, const char* msg)
+    {
+        if (parser.current.type == type) {
+            advance();
+            return;
+        }
+
+        error_at_current(msg);
+    }
+
+    void expression()
+    {
+        parse_precedence(Prec::Assignment);
+    }
+
+    void number()
+    {
+        Value value = scanner->numbers[parser.previous.literal];
+        if (compiling_registers != nullptr) {
+            operand = register_emitter.constant(value);
+            check_registers();
+        }
+        else {
+            emit_constant(value);
+        }
+        expression_type = StaticType::Number;
+    }
+
+    void emit_byte(Byte byte)
+    {
+        auto current = compiling_chunk;
+        current->write(byte, scanner->line_of(parser.previous));
+    }
+
+    // keep track of the stack depth the emitted code needs
+    void track_stack(OpCode op)
+    {
+        OpInfo const& info = op_info(op);
+        compiling_depth += info.pushes - info.pops;
+        if (compiling_depth > compiling_chunk->max_stack) {
+            compiling_chunk->max_stack = compiling_depth;
+        }
+    }
+
+    // emit an instruction without operands
+    void emit_op(OpCode op)
+    {
+        track_stack(op);
+        if (superinstructions && compiling_chunk->fuse(last_instruction, op)) {
+            return;
+        }
+        last_instruction = (Index)compiling_chunk->code.size();
+        emit_byte(op);
+    }
+
+    // the unchecked form when the operand types are numbers, the register tier
+    // also needs the left operand of a binary op (the right one is 'operand')
+    void emit_arithmetic(OpCode op, StaticType a, StaticType b, Operand left = {})
+    {
+        if (compiling_registers != nullptr) {
+            Index line = scanner->line_of(parser.previous);
+            operand = (op == OP_Negate) ? register_emitter.negate(operand, line)
+                                        : register_emitter.binary((RegOp)(R_Add + (op - OP_Add)), left, operand, line);
+            check_registers();
+        }
+        else {
+            emit_op(unchecked_arithmetic ? Types::arithmetic_op(op, a, b) : op);
+        }
+        expression_type = Types::result_type(op);
+    }
+
+    // the register tier has tighter limits than the stack byte code
+    void check_registers()
+    {
+        if (register_emitter.error != nullptr) {
+            error(register_emitter.error);
+            register_emitter.error = nullptr;
+        }
+    }
+
+    void emit_print()
+    {
+        if (compiling_registers != nullptr) {
+            register_emitter.finish(R_Print, operand, scanner->line_of(parser.previous));
+            check_registers();
+            return;
+        }
+        emit_op(OP_Print);
+    }
+
+    void emit_constant(Value value)
+    {
+        track_stack(OP_Constant);
+        Index constant = make_constant(value);
+        last_instruction = (Index)compiling_chunk->code.size();
+        compiling_chunk->write_constant(constant, scanner->line_of(parser.previous));
+    }
+
+    Index make_constant(Value value)
+    {
+        auto c = compiling_chunk;
+        auto constant = c->add_const(value);
+        if (constant > 0xffffff) { // 24-bit operand of OP_Constant_Long
+            error("Too many constants in one chunk.");
+            return 0;
+        }
+
+        return constant;
+    }
+
+    void grouping()
+    {
+        expression();
+        consume(Token::RightParen, "Expected ')' after expression.");
+    }
+
+    void unary()
+    {
+        Token::Type operator_type = parser.previous.type;
+
+        // compile operand
+        expression();
+        StaticType operand_type = expression_type;
+
+        // emit operator instruction
+        switch (operator_type) {
+        case Token::Minus:
+            emit_arithmetic(OP_Negate, operand_type, StaticType::Number);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+    }
+
+    void binary()
+    {
+        // remember operator and the left operand
+        Token::Type operatorType = parser.previous.type;
+        StaticType left = expression_type;
+        Operand left_operand = operand;
+
+        // compile right operand.
+        ParseRule* rule = get_rule(operatorType);
+        auto next_prec_level = (int)rule->precedence + 1;
+        parse_precedence((Precedence)(next_prec_level));
+        StaticType right = expression_type;
+
+        // Emit the operator instruction.
+        switch (operatorType) {
+        case Token::Plus:
+            emit_arithmetic(OP_Add, left, right, left_operand);
+            break;
+        case Token::Minus:
+            emit_arithmetic(OP_Subtract, left, right, left_operand);
+            break;
+        case Token::Star:
+            emit_arithmetic(OP_Multiply, left, right, left_operand);
+            break;
+        case Token::Slash:
+            emit_arithmetic(OP_Divide, left, right, left_operand);
+            break;
+        default:
+            return; // Unreachable.
+        }
+    }
+
+    ParseRule* get_rule(Token::Type type)
+    {
+        return &rules[type];
+    }
+
+    void parse_precedence(Precedence prec)
+    {
+        advance();
+        auto prefixRule = get_rule(parser.previous.type);
+        auto prefix = prefixRule->prefix;
+        if (prefix == nullptr) {
+            error("Expect expression.");
+            return;
+        }
+
+        (*this.*prefix)(); // pretty sure thats the most horrible expression that I have ever to write in c++...
+
+        while (prec <= get_rule(parser.current.type)->precedence) {
+            advance();
+            auto infixRule = get_rule(parser.previous.type);
+            auto infix = infixRule->infix;
+            if (infix == nullptr) {
+                error("Expect operator.");
+                return;
+            }
+            (*this.*infix)();
+        }
+    }
+
+    void emit_bytes(Byte byte1, Byte byte2)
+    {
+        emit_byte(byte1);
+        emit_byte(byte2);
+    }
+
+    void end_compiler()
+    {
+        emit_return();
+    }
+
+    void emit_return()
+    {
+        if (compiling_registers != nullptr) {
+            register_emitter.finish(R_Return, operand, scanner->line_of(parser.previous));
+            check_registers();
+            return;
+        }
+        emit_op(OP_Return);
+    }
+};
\ No newline at end of file
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+#include "Chunk.h"
+#include "OpCodes.h"
+#include "Value.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CPP_BACKEND_DLOPEN
+#include <dlfcn.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+// where the generated code finds Value.h when the check builds it, CMake passes the source dir
+#if !defined(LOX_SOURCE_DIR)
+#define LOX_SOURCE_DIR "."
+#endif
+
+// Ahead-of-time backend: translates compiled chunks into a C++ source file with one
+// straight line function per chunk,
+//
+//   extern "C" int lox_chunk_<n>(Value* result); // 0: returned, 1: runtime error
+//
+// Every stack slot becomes an element of a local Value array and every instruction
+// the same statement VM::run would execute for it: the checked ops keep their type
+// checks and report runtime errors in the same words, the unchecked ones don't
+// check. The file includes Value.h (and defines NAN_BOXING when this build uses it),
+// so the values are the same on both sides of a dlopen.
+namespace CppBackend {
+
+static std::string function_name(Index chunk)
+{
+    return "lox_chunk_" + std::to_string(chunk);
+}
+
+// exact, even for inf and NaN
+static std::string number_literal(Number number)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &number, sizeof(bits));
+    char text[64];
+    std::snprintf(text, sizeof(text), "lox_bits(0x%016llxull) /* %.17g */", (unsigned long long)bits, number);
+    return text;
+}
+
+static std::string value_literal(Value const& value)
+{
+    if (IS_NUMBER(value)) { return "Value(" + number_literal(AS_NUMBER(value)) + ")"; }
+    if (IS_BOOL(value))   { return AS_BOOL(value) ? "Value(true)" : "Value(false)"; }
+    return "Value(Nil{})";
+}
+
+static std::string slot(int n)
+{
+    return "s[" + std::to_string(n) + "]";
+}
+
+static const char* cpp_operator(OpCode op)
+{
+    switch (op) {
+    case OP_Add:      case OP_Add_Const:      return "+";
+    case OP_Subtract: case OP_Subtract_Const: return "-";
+    case OP_Multiply: case OP_Multiply_Const: return "*";
+    default:                                  return "/";
+    }
+}
+
+static void emit_chunk(std::string& out, ChunkView const& chunk, Index number)
+{
+    out += "extern \"C\" int " + function_name(number) + "(Value* result)\n{\n";
+    out += "    Value s[" + std::to_string(std::max(chunk.max_stack, 1)) + "];\n";
+
+    int depth = 0;
+    for (Index offset = 0; offset < chunk.code_size; offset += 1 + op_info(chunk.code[offset]).operands) {
+        Byte byte = chunk.code[offset];
+        const bool checked = !is_unchecked(byte);
+        const OpCode op = checked_op(generic_op(byte)); // quickened code translates like the original
+        const std::string line = std::to_string(chunk.line_at(offset));
+        const int top = depth - 1;
+        std::string code;
+
+        switch (op) {
+        case OP_Constant:
+        case OP_Constant_Long:
+            code = slot(top + 1) + " = " + value_literal(chunk.constants[chunk.constant_index(offset)]) + ";";
+            break;
+
+        case OP_Add:
+        case OP_Subtract:
+        case OP_Multiply:
+        case OP_Divide:
+            if (checked) {
+                code = "if (!IS_NUMBER(" + slot(top - 1) + ") || !IS_NUMBER(" + slot(top) + ")) { return lox_error(\"Operands must be numbers.\", " + line + "); }\n    ";
+            }
+            code += slot(top - 1) + " = AS_NUMBER(" + slot(top - 1) + ") " + cpp_operator(op) + " AS_NUMBER(" + slot(top) + ");";
+            break;
+
+        case OP_Add_Const:
+        case OP_Subtract_Const:
+        case OP_Multiply_Const:
+        case OP_Divide_Const:
+            if (checked) {
+                code = "if (!IS_NUMBER(" + slot(top) + ")) { return lox_error(\"Operands must be numbers.\", " + line + "); }\n    ";
+            }
+            code += slot(top) + " = AS_NUMBER(" + slot(top) + ") " + cpp_operator(op) + " "
+                + number_literal(AS_NUMBER(chunk.constants[chunk.constant_index(offset)])) + ";";
+            break;
+
+        case OP_Negate:
+            if (checked) {
+                code = "if (!IS_NUMBER(" + slot(top) + ")) { return lox_error(\"Operand must be a number!\", " + line + "); }\n    ";
+            }
+            code += slot(top) + " = -AS_NUMBER(" + slot(top) + ");";
+            break;
+
+        case OP_Negate_Const:
+            code = slot(top + 1) + " = -" + number_literal(AS_NUMBER(chunk.constants[chunk.constant_index(offset)])) + ";";
+            break;
+
+        case OP_Get_Slot:
+            code = slot(top + 1) + " = " + slot(chunk.code[offset + 1]) + ";";
+            break;
+
+        case OP_Set_Slot:
+            code = slot(chunk.code[offset + 1]) + " = " + slot(top) + ";";
+            break;
+
+        case OP_Print:
+            code = "print_value(" + slot(top) + "); std::printf(\"\\n\");";
+            break;
+
+        case OP_Return:
+            code = "*result = " + slot(top) + "; return 0;";
+            break;
+
+        default:
+            code = "return lox_error(\"Unknown opcode.\", " + line + ");";
+            break;
+        }
+
+        OpInfo const& info = op_info(byte);
+        depth += info.pushes - info.pops;
+        out += "    " + code + "\n";
+    }
+    out += "}\n\n";
+}
+
+// the whole file for the chunks of one script
+static std::string emit(std::vector<ChunkView> const& chunks, std::string const& origin)
+{
+    std::string out;
+    out += "// Generated by the lox C++ backend from " + origin + ", build it with the lox sources\n";
+    out += "// on the include path:\n";
+    out += "//   c++ -std=c++17 -O2 -shared -fPIC -I<lox> <this file> -o <library>\n\n";
+#if defined(NAN_BOXING)
+    out += "#define NAN_BOXING\n";
+#endif
+    out += "#include <cstdio>\n#include <cstring>\n\n#include \"Value.h\"\n\n";
+    out += "static inline Number lox_bits(uint64_t bits)\n{\n    Number number;\n"
+           "    std::memcpy(&number, &bits, sizeof(number));\n    return number;\n}\n\n";
+    out += "static int lox_error(const char* message, int line)\n{\n"
+           "    std::fprintf(stderr, \"%s\\n[line %d] in script\\n\", message, line);\n    return 1;\n}\n\n";
+    out += "extern \"C\" const int lox_chunk_count = " + std::to_string(chunks.size()) + ";\n\n";
+
+    for (std::size_t n = 0; n < chunks.size(); ++n) {
+        emit_chunk(out, chunks[n], (Index)n);
+    }
+    return out;
+}
+
+static bool write(std::string const& path, std::string const& source)
+{
+    std::ofstream file(path, std::ios::binary);
+    file << source;
+    return (bool)file;
+}
+
+#if defined(CPP_BACKEND_DLOPEN)
+
+using ChunkFunction = int (*)(Value*);
+
+// a generated file built into a shared object and loaded
+struct Library {
+    void* handle = nullptr;
+
+    Library() = default;
+    Library(Library const&) = delete;
+    Library& operator=(Library const&) = delete;
+
+    ~Library()
+    {
+        if (handle != nullptr) { dlclose(handle); }
+    }
+
+    ChunkFunction function(Index chunk) const
+    {
+        return (ChunkFunction)dlsym(handle, function_name(chunk).c_str());
+    }
+};
+
+// Runs args[0] with args, searched on PATH, and waits for it. True when it exited with 0.
+static bool run(std::vector<std::string> const& args)
+{
+    std::vector<char*> argv;
+    for (std::string const& arg : args) { argv.push_back(const_cast<char*>(arg.c_str())); }
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    int error = posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ);
+    if (error != 0) {
+        std::fprintf(stderr, "can't run '%s': %s\n", argv[0], std::strerror(error));
+        return false;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) { return false; }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Writes source to <base>.cpp, builds <base>.so with $CXX (or c++) and loads it.
+// Null when that fails, the reason is on stderr.
+static std::unique_ptr<Library> build(std::string const& source, std::string const& base)
+{
+    const std::string cpp = base + ".cpp";
+    const std::string so = base + ".so";
+    if (!write(cpp, source)) {
+        std::fprintf(stderr, "can't write '%s'\n", cpp.c_str());
+        return nullptr;
+    }
+
+    // the compiler runs without a shell, so paths need no quoting; $CXX may carry a launcher like ccache
+    std::vector<std::string> args;
+    const char* cxx = std::getenv("CXX");
+    std::string words = (cxx != nullptr && *cxx != '\0') ? cxx : "c++";
+    for (std::size_t at = 0; (at = words.find_first_not_of(' ', at)) != std::string::npos; /**/) {
+        std::size_t end = std::min(words.find(' ', at), words.size());
+        args.push_back(words.substr(at, end - at));
+        at = end;
+    }
+    for (const char* arg : { "-std=c++17", "-O2", "-shared", "-fPIC", "-I" LOX_SOURCE_DIR }) {
+        args.push_back(arg);
+    }
+    args.insert(args.end(), { cpp, "-o", so });
+    if (!run(args)) {
+        std::string command;
+        for (std::string const& arg : args) { command += (command.empty() ? "" : " ") + arg; }
+        std::fprintf(stderr, "failed: %s\n", command.c_str());
+        return nullptr;
+    }
+
+    // without a slash dlopen searches the library path instead
+    const std::string path = (so.find('/') == std::string::npos) ? "./" + so : so;
+    auto library = std::make_unique<Library>();
+    library->handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (library->handle == nullptr) {
+        std::fprintf(stderr, "dlopen: %s\n", dlerror());
+        return nullptr;
+    }
+    return library;
+}
+
+#endif
+
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+
 #include "Common.h"
 #include "Chunk.h"
 #include "OpCodes.h"
@@ -7,56 +10,98 @@
 namespace Debug {
 
 
-static void  show(Chunk& chunk, const char* name);
-static Index show(Chunk& chunk, Index current);
+static const char* op_name(Byte op);
+static int name_width();
+static inline void show(ChunkView const& chunk, const char* name);
+static Index show(ChunkView const& chunk, Index current);
 static Index simple_instruction(const char* name, Index offset);
-static Index constant_instruction(const char* name, Chunk& chunk, Index offset);
+static Index constant_instruction(const char* name, ChunkView const& chunk, Index offset);
+static Index slot_instruction(const char* name, ChunkView const& chunk, Index offset);
+
+static const char* op_name(Byte op)
+{
+    switch (op) {
+    case OP_Constant:                 return "CONSTANT";
+    case OP_Constant_Long:            return "CONSTANT_LONG";
+    case OP_Negate:                   return "NEGATE";
+    case OP_Add:                      return "ADD";
+    case OP_Subtract:                 return "SUBTRACT";
+    case OP_Multiply:                 return "MULTIPLY";
+    case OP_Divide:                   return "DIVIDE";
+    case OP_Print:                    return "PRINT";
+    case OP_Return:                   return "RETURN";
+    case OP_Add_NumNum:               return "ADD_NUM_NUM";
+    case OP_Subtract_NumNum:          return "SUBTRACT_NUM_NUM";
+    case OP_Multiply_NumNum:          return "MULTIPLY_NUM_NUM";
+    case OP_Divide_NumNum:            return "DIVIDE_NUM_NUM";
+    case OP_Add_Const:                return "ADD_CONST";
+    case OP_Subtract_Const:           return "SUBTRACT_CONST";
+    case OP_Multiply_Const:           return "MULTIPLY_CONST";
+    case OP_Divide_Const:             return "DIVIDE_CONST";
+    case OP_Negate_Const:             return "NEGATE_CONST";
+    case OP_Add_Unchecked:            return "ADD_UNCHECKED";
+    case OP_Subtract_Unchecked:       return "SUBTRACT_UNCHECKED";
+    case OP_Multiply_Unchecked:       return "MULTIPLY_UNCHECKED";
+    case OP_Divide_Unchecked:         return "DIVIDE_UNCHECKED";
+    case OP_Negate_Unchecked:         return "NEGATE_UNCHECKED";
+    case OP_Add_Const_Unchecked:      return "ADD_CONST_UNCHECKED";
+    case OP_Subtract_Const_Unchecked: return "SUBTRACT_CONST_UNCHECKED";
+    case OP_Multiply_Const_Unchecked: return "MULTIPLY_CONST_UNCHECKED";
+    case OP_Divide_Const_Unchecked:   return "DIVIDE_CONST_UNCHECKED";
+    case OP_Get_Slot:                 return "GET_SLOT";
+    case OP_Set_Slot:                 return "SET_SLOT";
+    default:                          return "?";
+    }
+}
+
+// the longest opcode name, so the operands line up
+static int name_width()
+{
+    static const int width = [] {
+        std::size_t longest = 0;
+        for (Byte op = 1; op < OP_Count; ++op) { longest = std::max(longest, std::strlen(op_name(op))); }
+        return (int)longest;
+    }();
+    return width;
+}
 
 // print every operation in a chunk
-static void show(Chunk& chunk, const char* name)
+static inline void show(ChunkView const& chunk, const char* name)
 {
     std::printf("%s \n", name);
     std::printf("=================================\n");
-    std::printf("Index|Line| OpCode        |Values\n");
+    std::printf("Index|Line| %-*s|Values\n", name_width(), "OpCode");
     std::printf("=================================\n");
-    for (int i = 0; i < chunk.code.size();/**/) {
+    for (int i = 0; i < chunk.code_size;/**/) {
         i = show(chunk, i);
     }
 }
 
 // print an instruction at a specific Index
-static Index show(Chunk& chunk, Index offset)
+static Index show(ChunkView const& chunk, Index offset)
 {
     std::printf("%04d ", offset);
 
-    if (offset > 0 && chunk.lines[offset] == chunk.lines[offset - 1]) {
+    Index line = chunk.line_at(offset);
+    if (offset > 0 && line == chunk.line_at(offset - 1)) {
         std::printf("     | ");
     }
     else {
-        std::printf("%4d | ", chunk.lines[offset]);
+        std::printf("%4d | ", line);
     }
 
-    OpCode instruction = (OpCode)chunk.code[offset];
-    switch (instruction) {
-    case OP_Constant:
-        return constant_instruction("CONSTANT", chunk, offset);
-    case OP_Negate:
-        return simple_instruction("NEGATE", offset);
-    case OP_Add:
-        return simple_instruction("ADD", offset);
-    case OP_Subtract:
-        return simple_instruction("SUBTRACT", offset);
-    case OP_Multiply:
-        return simple_instruction("MULTIPLY", offset);
-    case OP_Divide:
-        return simple_instruction("Divide", offset);
-    case OP_Return:
-        return simple_instruction("RETURN", offset);
-    default:
+    Byte instruction = chunk.code[offset];
+    if (!is_opcode(instruction)) {
         std::printf("%d unkown opcode!\n", instruction);
-        break;
+        return offset + 1;
     }
-    return offset + 1;
+    if (has_constant_operand(instruction)) {
+        return constant_instruction(op_name(instruction), chunk, offset);
+    }
+    if (has_slot_operand(instruction)) {
+        return slot_instruction(op_name(instruction), chunk, offset);
+    }
+    return simple_instruction(op_name(instruction), offset);
 }
 
 // print a simple instruction (returns, breaks, ...)
@@ -66,13 +111,19 @@ static Index simple_instruction(const char* name, Index offset)
     return offset + 1;
 }
 
-static Index constant_instruction(const char* name, Chunk& chunk, Index offset)
+static Index constant_instruction(const char* name, ChunkView const& chunk, Index offset)
 {
-    Byte constant_index = chunk.code[offset + 1];
-    std::printf("%-16s %4d '", name, constant_index);
-    std::printf("%g", chunk.constants[constant_index]);
+    Index constant_index = chunk.constant_index(offset);
+    std::printf("%-*s %4d '", name_width(), name, constant_index);
+    print_value(chunk.constants[constant_index]);
     std::printf("'\n");
-    return offset + 2; // one for the opcode, one for the index of the value!
+    return offset + 1 + op_info(chunk.code[offset]).operands; // the opcode and the index of the value!
+}
+
+static Index slot_instruction(const char* name, ChunkView const& chunk, Index offset)
+{
+    std::printf("%-*s %4d\n", name_width(), name, chunk.code[offset + 1]);
+    return offset + 2;
 }
 
 }
\ No newline at end of file
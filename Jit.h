@@ -0,0 +1,537 @@
+#pragma once
+
+#include <cstring>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "Common.h"
+#include "Chunk.h"
+#include "OpCodes.h"
+#include "Value.h"
+
+// Baseline JIT: translates a hot chunk into x86-64 machine code by stitching
+// together one template per instruction, VM::interpret runs that code instead of
+// VM::run once a chunk was run 'threshold' times.
+//
+// Chunks are straight line code that starts on an empty stack, so the JIT knows
+// every stack slot at compile time: its depth and whether it holds a number. The
+// slots live in XMM registers (xmm2..xmm15 for the lowest ones, the deeper ones
+// in a frame of doubles) and the type guards of the interpreter turn into a jump
+// to the error exit where an operand isn't a number, which reports the runtime
+// error like VM::run would. Printing and returning call back into C++.
+// Instructions it doesn't know make it give up on the chunk, VM::run takes it.
+//
+// Only x86-64 Linux (System V ABI, mmap) has the JIT, build with NO_JIT to leave
+// it out there too; everywhere else compile() always gives up.
+#if !defined(NO_JIT) && defined(__x86_64__) && defined(__linux__)
+#define JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Jit {
+
+// what the machine code gets from VM::run_native, the frame has to stay first
+struct Context {
+    double* frame = nullptr; // home of every stack slot, slot n at frame[n]
+    Value result;
+    Index error_offset = -1; // of the instruction that failed its type guard
+    const char* error = nullptr;
+};
+
+using Entry = int (*)(Context*); // 0: returned, 1: runtime error
+
+// machine code of one chunk
+struct Code {
+    void* memory = nullptr;
+    std::size_t size = 0;
+    Entry entry = nullptr;
+    std::vector<double> frame;
+
+    Code() = default;
+    Code(Code const&) = delete;
+    Code& operator=(Code const&) = delete;
+
+    ~Code()
+    {
+#if defined(JIT)
+        if (memory != nullptr) { munmap(memory, size); }
+#endif
+    }
+};
+
+#if defined(JIT)
+
+// called from the machine code
+static void print_number(double number)
+{
+    print_value(number);
+    std::printf("\n");
+}
+
+static void print_constant(const Value* value)
+{
+    print_value(*value);
+    std::printf("\n");
+}
+
+static void return_number(Context* context, double number)
+{
+    context->result = number;
+}
+
+static void return_constant(Context* context, const Value* value)
+{
+    context->result = *value;
+}
+
+static void fail(Context* context, int offset, const char* error)
+{
+    context->error_offset = offset;
+    context->error = error;
+}
+
+static const int REGISTER_SLOTS = 14; // slot n < 14 lives in xmm(n + 2), xmm0/xmm1 are scratch
+
+// x86-64 encoder for the few instructions the templates need; r12 holds the frame,
+// rbx the Context
+struct Assembler {
+    Bytes code;
+
+    void bytes(std::initializer_list<Byte> list) { code.insert(code.end(), list); }
+
+    void imm32(uint32_t value)
+    {
+        for (int n = 0; n < 4; ++n) { code.push_back((Byte)(value >> (8 * n))); }
+    }
+
+    void imm64(uint64_t value)
+    {
+        for (int n = 0; n < 8; ++n) { code.push_back((Byte)(value >> (8 * n))); }
+    }
+
+    // prefix [REX] 0F op with register operands
+    void sse(Byte prefix, Byte op, int reg, int rm)
+    {
+        code.push_back(prefix);
+        if (reg >= 8 || rm >= 8) { code.push_back((Byte)(0x40 | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0))); }
+        bytes({ 0x0f, op, (Byte)(0xc0 | ((reg & 7) << 3) | (rm & 7)) });
+    }
+
+    // prefix REX 0F op with the memory operand [r12 + disp]
+    void sse_frame(Byte prefix, Byte op, int reg, int disp)
+    {
+        bytes({ prefix, (Byte)(0x41 | (reg >= 8 ? 4 : 0)), 0x0f, op, (Byte)(0x84 | ((reg & 7) << 3)), 0x24 });
+        imm32((uint32_t)disp);
+    }
+
+    void mov_rax(uint64_t value) { bytes({ 0x48, 0xb8 }); imm64(value); }
+    void mov_rsi(uint64_t value) { bytes({ 0x48, 0xbe }); imm64(value); }
+    void mov_rdi(uint64_t value) { bytes({ 0x48, 0xbf }); imm64(value); }
+    void mov_rdx(uint64_t value) { bytes({ 0x48, 0xba }); imm64(value); }
+    void mov_esi(uint32_t value) { code.push_back(0xbe); imm32(value); }
+    void mov_eax(uint32_t value) { code.push_back(0xb8); imm32(value); }
+    void mov_rdi_rbx()           { bytes({ 0x48, 0x89, 0xdf }); }
+
+    void movq_xmm_rax(int xmm)
+    {
+        bytes({ 0x66, (Byte)(0x48 | (xmm >= 8 ? 4 : 0)), 0x0f, 0x6e, (Byte)(0xc0 | ((xmm & 7) << 3)) });
+    }
+
+    void mov_frame_rax(int disp) // mov [r12 + disp], rax
+    {
+        bytes({ 0x49, 0x89, 0x84, 0x24 });
+        imm32((uint32_t)disp);
+    }
+
+    template <class Fn>
+    void call(Fn* fn)
+    {
+        mov_rax((uint64_t)(uintptr_t)fn);
+        bytes({ 0xff, 0xd0 }); // call rax
+    }
+
+    void prologue()
+    {
+        bytes({ 0x53 });                   // push rbx
+        bytes({ 0x41, 0x54 });             // push r12
+        bytes({ 0x48, 0x83, 0xec, 0x08 }); // sub rsp, 8 (calls need a 16 byte aligned stack)
+        bytes({ 0x48, 0x89, 0xfb });       // mov rbx, rdi
+        bytes({ 0x4c, 0x8b, 0x23 });       // mov r12, [rbx] (Context::frame)
+    }
+
+    void epilogue(int status)
+    {
+        mov_eax((uint32_t)status);
+        bytes({ 0x48, 0x83, 0xc4, 0x08 }); // add rsp, 8
+        bytes({ 0x41, 0x5c });             // pop r12
+        bytes({ 0x5b });                   // pop rbx
+        bytes({ 0xc3 });                   // ret
+    }
+};
+
+// SSE opcodes (0F xx) used by the templates
+enum : Byte { MOVSD_LOAD = 0x10, MOVSD_STORE = 0x11, MOVAPD = 0x28, XORPD = 0x57,
+              ADDSD = 0x58, MULSD = 0x59, SUBSD = 0x5c, DIVSD = 0x5e };
+
+// the templates, in terms of stack slots
+struct Templates {
+    Assembler a;
+
+    static bool in_register(int slot) { return slot < REGISTER_SLOTS; }
+    static int xmm(int slot) { return slot + 2; }
+    static int home(int slot) { return slot * 8; }
+
+    static uint64_t bits(Number number)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &number, sizeof(bits));
+        return bits;
+    }
+
+    void load_number(int slot, Number number)
+    {
+        a.mov_rax(bits(number));
+        if (in_register(slot)) { a.movq_xmm_rax(xmm(slot)); }
+        else                   { a.mov_frame_rax(home(slot)); }
+    }
+
+    // the register to compute slot in, xmm0 for slots in the frame
+    int begin(int slot)
+    {
+        if (in_register(slot)) { return xmm(slot); }
+        a.sse_frame(0xf2, MOVSD_LOAD, 0, home(slot));
+        return 0;
+    }
+
+    void end(int slot)
+    {
+        if (!in_register(slot)) { a.sse_frame(0xf2, MOVSD_STORE, 0, home(slot)); }
+    }
+
+    // slot op= slot + 1
+    void binary(Byte op, int slot)
+    {
+        int target = begin(slot);
+        if (in_register(slot + 1)) { a.sse(0xf2, op, target, xmm(slot + 1)); }
+        else                       { a.sse_frame(0xf2, op, target, home(slot + 1)); }
+        end(slot);
+    }
+
+    // slot op= number
+    void binary_constant(Byte op, int slot, Number number)
+    {
+        a.mov_rax(bits(number));
+        a.movq_xmm_rax(1);
+        int target = begin(slot);
+        a.sse(0xf2, op, target, 1);
+        end(slot);
+    }
+
+    void negate(int slot)
+    {
+        a.mov_rax(0x8000000000000000ull);
+        a.movq_xmm_rax(1);
+        int target = begin(slot);
+        a.sse(0x66, XORPD, target, 1);
+        end(slot);
+    }
+
+    // to = from, for numbers
+    void copy(int from, int to)
+    {
+        if (from == to) { return; }
+        int target = in_register(to) ? xmm(to) : 0;
+        if (in_register(from)) { a.sse(0x66, MOVAPD, target, xmm(from)); }
+        else                   { a.sse_frame(0xf2, MOVSD_LOAD, target, home(from)); }
+        end(to);
+    }
+
+    void to_xmm0(int slot)
+    {
+        if (in_register(slot)) { a.sse(0x66, MOVAPD, 0, xmm(slot)); }
+        else                   { a.sse_frame(0xf2, MOVSD_LOAD, 0, home(slot)); }
+    }
+
+    // every XMM register is caller saved, slots below 'depth' go to their home around calls
+    void save(int depth)
+    {
+        for (int slot = 0; slot < depth && in_register(slot); ++slot) { a.sse_frame(0xf2, MOVSD_STORE, xmm(slot), home(slot)); }
+    }
+
+    void restore(int depth)
+    {
+        for (int slot = 0; slot < depth && in_register(slot); ++slot) { a.sse_frame(0xf2, MOVSD_LOAD, xmm(slot), home(slot)); }
+    }
+
+    void error(Index offset, const char* message)
+    {
+        a.mov_rdi_rbx();
+        a.mov_esi((uint32_t)offset);
+        a.mov_rdx((uint64_t)(uintptr_t)message);
+        a.call(&fail);
+        a.epilogue(1);
+    }
+};
+
+static Byte sse_op(OpCode op)
+{
+    switch (op) {
+    case OP_Add:      case OP_Add_Const:      return ADDSD;
+    case OP_Subtract: case OP_Subtract_Const: return SUBSD;
+    case OP_Multiply: case OP_Multiply_Const: return MULSD;
+    default:                                  return DIVSD;
+    }
+}
+
+// machine code for a verified chunk, null when it has instructions the JIT doesn't know
+// (or there is no executable memory); the constants have to outlive the code
+static std::unique_ptr<Code> compile(ChunkView const& chunk)
+{
+    // what the code leaves in a slot: a number or a constant of another type
+    struct Slot {
+        bool number;
+        const Value* constant;
+    };
+    std::vector<Slot> stack;
+
+    Templates t;
+    t.a.prologue();
+
+    bool done = false;
+    for (Index offset = 0; offset < chunk.code_size && !done; offset += 1 + op_info(chunk.code[offset]).operands) {
+        // quickened, unchecked and checked instructions all compile the same, the guards
+        // below are decided here and now
+        OpCode op = checked_op(generic_op(chunk.code[offset]));
+        int top = (int)stack.size() - 1;
+
+        switch (op) {
+        case OP_Constant:
+        case OP_Constant_Long: {
+            Value const& value = chunk.constants[chunk.constant_index(offset)];
+            if (IS_NUMBER(value)) {
+                t.load_number(top + 1, AS_NUMBER(value));
+                stack.push_back({ true, nullptr });
+            }
+            else {
+                stack.push_back({ false, &value });
+            }
+            break;
+        }
+
+        case OP_Add:
+        case OP_Subtract:
+        case OP_Multiply:
+        case OP_Divide:
+            if (!stack[top].number || !stack[top - 1].number) {
+                t.error(offset, "Operands must be numbers.");
+                done = true;
+                break;
+            }
+            t.binary(sse_op(op), top - 1);
+            stack.pop_back();
+            break;
+
+        case OP_Add_Const:
+        case OP_Subtract_Const:
+        case OP_Multiply_Const:
+        case OP_Divide_Const:
+            if (!stack[top].number) {
+                t.error(offset, "Operands must be numbers.");
+                done = true;
+                break;
+            }
+            t.binary_constant(sse_op(op), top, AS_NUMBER(chunk.constants[chunk.constant_index(offset)]));
+            break;
+
+        case OP_Negate:
+            if (!stack[top].number) {
+                t.error(offset, "Operand must be a number!");
+                done = true;
+                break;
+            }
+            t.negate(top);
+            break;
+
+        case OP_Negate_Const:
+            t.load_number(top + 1, -AS_NUMBER(chunk.constants[chunk.constant_index(offset)]));
+            stack.push_back({ true, nullptr });
+            break;
+
+        case OP_Get_Slot: {
+            int slot = chunk.code[offset + 1];
+            if (stack[slot].number) {
+                t.copy(slot, top + 1);
+            }
+            stack.push_back(stack[slot]);
+            break;
+        }
+
+        case OP_Set_Slot: {
+            int slot = chunk.code[offset + 1];
+            if (stack[top].number) {
+                t.copy(top, slot);
+            }
+            stack[slot] = stack[top];
+            break;
+        }
+
+        case OP_Print:
+            t.save(top);
+            if (stack[top].number) {
+                t.to_xmm0(top);
+                t.a.call(&print_number);
+            }
+            else {
+                t.a.mov_rdi((uint64_t)(uintptr_t)stack[top].constant);
+                t.a.call(&print_constant);
+            }
+            t.restore(top);
+            stack.pop_back();
+            break;
+
+        case OP_Return:
+            if (stack[top].number) {
+                t.to_xmm0(top);
+                t.a.mov_rdi_rbx();
+                t.a.call(&return_number);
+            }
+            else {
+                t.a.mov_rdi_rbx();
+                t.a.mov_rsi((uint64_t)(uintptr_t)stack[top].constant);
+                t.a.call(&return_constant);
+            }
+            t.a.epilogue(0);
+            done = true;
+            break;
+
+        default:
+            return nullptr; // VM::run it is
+        }
+    }
+
+    auto code = std::make_unique<Code>();
+    const std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+    code->size = (t.a.code.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, code->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    code->memory = memory;
+
+    // never writable and executable at the same time
+    std::memcpy(memory, t.a.code.data(), t.a.code.size());
+    if (mprotect(memory, code->size, PROT_READ | PROT_EXEC) != 0) {
+        return nullptr;
+    }
+    code->entry = (Entry)memory;
+    code->frame.resize(std::max(chunk.max_stack, 1));
+    return code;
+}
+
+#else
+
+static std::unique_ptr<Code> compile(ChunkView const&)
+{
+    return nullptr;
+}
+
+#endif
+
+// Counts the runs of every chunk a VM sees and compiles the ones that get hot.
+// Entries only watch their chunk, how long it lives is up to CompileCache or the
+// host; an entry whose chunk died is dropped once another chunk shows up at the
+// address. The least recently run are dropped, with their machine code, past the limits.
+struct Cache {
+    struct Entry {
+        const Chunk* key;
+        std::weak_ptr<const Chunk> chunk;
+        int runs = 0;
+        std::unique_ptr<Code> code; // null until compiled, or when the JIT gave up
+    };
+    using Entries = std::list<Entry>; // most recently run first
+
+#if defined(JIT) && !defined(PROFILE_OPCODES) // the profiler counts interpreted instructions
+    bool enabled = true;
+#else
+    bool enabled = false;
+#endif
+    int threshold = 10; // runs before a chunk is compiled
+    std::size_t max_entries = 4096;
+    std::size_t max_code_bytes = 16 << 20; // mapped machine code, whole pages
+    std::size_t code_bytes = 0;
+    std::size_t compiled = 0;
+    std::size_t gave_up = 0;
+    std::size_t evictions = 0;
+    Entries entries;
+    std::unordered_map<const Chunk*, Entries::iterator> index;
+
+    // the machine code for chunk, null while it's cold or couldn't be compiled;
+    // valid until the next call
+    Code* hot(std::shared_ptr<const Chunk> const& chunk)
+    {
+        if (!enabled) {
+            return nullptr;
+        }
+
+        auto found = index.find(chunk.get());
+        if (found != index.end() && found->second->chunk.expired()) {
+            remove(found->second); // machine code of a chunk that is gone
+            found = index.end();
+        }
+        if (found == index.end()) {
+            entries.push_front(Entry{ chunk.get(), chunk, 0, nullptr });
+            index[chunk.get()] = entries.begin();
+        } else {
+            entries.splice(entries.begin(), entries, found->second);
+        }
+
+        Entry& entry = entries.front();
+        if (entry.code != nullptr) {
+            return entry.code.get();
+        }
+        if (++entry.runs != threshold) {
+            trim();
+            return nullptr;
+        }
+
+        entry.code = compile(ChunkView(*chunk));
+        if (entry.code == nullptr) {
+            gave_up++;
+            trim();
+            return nullptr;
+        }
+        compiled++;
+        code_bytes += entry.code->size;
+        trim();
+        return entry.code.get();
+    }
+
+    // the front entry is about to run, so it always stays
+    void trim()
+    {
+        while (entries.size() > 1 && (entries.size() > max_entries || code_bytes > max_code_bytes)) {
+            remove(std::prev(entries.end()));
+            evictions++;
+        }
+    }
+
+    void clear()
+    {
+        entries.clear();
+        index.clear();
+        code_bytes = 0;
+    }
+
+    void remove(Entries::iterator entry)
+    {
+        if (entry->code != nullptr) {
+            code_bytes -= entry->code->size;
+        }
+        index.erase(entry->key);
+        entries.erase(entry);
+    }
+};
+
+}
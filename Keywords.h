@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstring>
+#include <string_view>
+
+#include "Common.h"
+#include "Token.h"
+
+// Keyword recognition with a perfect hash that is built at compile time from the
+// keyword list below, so adding a keyword means adding one line to it.
+//
+// hash = (first char * a + second char * b + length) & (SLOTS - 1)
+//
+// a and b are searched by the compiler until no two keywords share a slot, a
+// lookup is then one hash, one length check and one memcmp.
+namespace Keywords {
+
+struct Keyword {
+    std::string_view text;
+    Token::Type type;
+};
+
+static constexpr Keyword list[] = {
+    { "and",    Token::And },
+    { "class",  Token::Class },
+    { "else",   Token::Else },
+    { "false",  Token::False },
+    { "for",    Token::For },
+    { "fun",    Token::Fun },
+    { "if",     Token::If },
+    { "nil",    Token::Nil },
+    { "or",     Token::Or },
+    { "print",  Token::Print },
+    { "return", Token::Return },
+    { "super",  Token::Super },
+    { "this",   Token::This },
+    { "true",   Token::True },
+    { "var",    Token::Var },
+    { "while",  Token::While },
+};
+
+static constexpr int SLOTS = 32;
+static constexpr int COUNT = sizeof(list) / sizeof(list[0]);
+static_assert(COUNT <= SLOTS, "more keywords than hash slots");
+
+static constexpr std::size_t min_length()
+{
+    std::size_t length = list[0].text.size();
+    for (auto const& keyword : list) { length = keyword.text.size() < length ? keyword.text.size() : length; }
+    return length;
+}
+
+static constexpr std::size_t max_length()
+{
+    std::size_t length = 0;
+    for (auto const& keyword : list) { length = keyword.text.size() > length ? keyword.text.size() : length; }
+    return length;
+}
+
+static_assert(min_length() >= 2, "the hash looks at the first two characters");
+
+struct Params {
+    unsigned a = 0;
+    unsigned b = 0;
+};
+
+static constexpr unsigned hash(Params params, Byte first, Byte second, std::size_t length)
+{
+    return (first * params.a + second * params.b + (unsigned)length) & (SLOTS - 1);
+}
+
+static constexpr bool collision_free(Params params)
+{
+    bool used[SLOTS] = {};
+    for (auto const& keyword : list) {
+        unsigned slot = hash(params, keyword.text[0], keyword.text[1], keyword.text.size());
+        if (used[slot]) { return false; }
+        used[slot] = true;
+    }
+    return true;
+}
+
+static constexpr Params find_params()
+{
+    for (unsigned a = 1; a < 64; ++a) {
+        for (unsigned b = 0; b < 64; ++b) {
+            if (collision_free({ a, b })) { return { a, b }; }
+        }
+    }
+    return {};
+}
+
+static constexpr Params params = find_params();
+static_assert(params.a != 0, "no perfect hash for the keyword list, try more SLOTS");
+
+struct Table {
+    int slots[SLOTS]; // index into list or -1
+};
+
+static constexpr Table make_table()
+{
+    Table table = {};
+    for (int& slot : table.slots) { slot = -1; }
+    for (int n = 0; n < COUNT; ++n) {
+        table.slots[hash(params, list[n].text[0], list[n].text[1], list[n].text.size())] = n;
+    }
+    return table;
+}
+
+static constexpr Table table = make_table();
+
+// keyword type of the identifier [start, start + length) or Token::Identifier
+static inline Token::Type lookup(const char* start, std::size_t length)
+{
+    if (length < min_length() || length > max_length()) {
+        return Token::Identifier;
+    }
+
+    int slot = table.slots[hash(params, (Byte)start[0], (Byte)start[1], length)];
+    if (slot < 0) {
+        return Token::Identifier;
+    }
+
+    Keyword const& keyword = list[slot];
+    if (keyword.text.size() == length && std::memcmp(start, keyword.text.data(), length) == 0) {
+        return keyword.type;
+    }
+    return Token::Identifier;
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "Common.h"
+
+// Line and column numbers of a source, resolved on demand. The scanner doesn't count
+// newlines any more, the first lookup records where every line starts (one memchr
+// pass) and later lookups are a binary search. Lookups mostly move forward (the
+// compiler asks for the line of every instruction), so the last line is tried first.
+struct LineIndex {
+    const char* source = nullptr;
+    std::size_t length = 0;
+    std::vector<uint32_t> starts; // offset of the first character of every line
+    Index last = 0; // line (0-based) of the last lookup
+
+    LineIndex() = default;
+    LineIndex(const char* source, std::size_t length) : source(source), length(length) {}
+
+    void build()
+    {
+        starts.push_back(0);
+        const char* end = source + length;
+        for (const char* p = source; p < end; ++p) {
+            p = (const char*)std::memchr(p, '\n', (std::size_t)(end - p));
+            if (p == nullptr) { break; }
+            starts.push_back((uint32_t)(p - source + 1));
+        }
+    }
+
+    // 1-based line of the character at offset
+    Index line(uint32_t offset)
+    {
+        if (starts.empty()) { build(); }
+
+        auto inside = [&](Index n) {
+            return starts[n] <= offset && (n + 1 == (Index)starts.size() || offset < starts[n + 1]);
+        };
+        if (!inside(last)) {
+            if (last + 1 < (Index)starts.size() && inside(last + 1)) {
+                last++;
+            }
+            else {
+                last = (Index)(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin()) - 1;
+            }
+        }
+        return last + 1;
+    }
+
+    // 1-based column of the character at offset
+    Index column(uint32_t offset)
+    {
+        Index n = line(offset) - 1;
+        return (Index)(offset - starts[n]) + 1;
+    }
+};
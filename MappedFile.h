@@ -0,0 +1,80 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Common.h"
+
+// a file in memory, mmap'ed read-only where possible
+struct MappedFile {
+    const Byte* data = nullptr;
+    std::size_t size = 0;
+
+    MappedFile() = default;
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(std::string const& path)
+    {
+        close();
+#if defined(_WIN32)
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) { return false; }
+
+        fallback.resize((std::size_t)file.tellg());
+        file.seekg(0);
+        file.read((char*)fallback.data(), fallback.size());
+        data = fallback.data();
+        size = fallback.size();
+        return (bool)file;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) { return false; }
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        if (info.st_size == 0) {
+            ::close(fd);
+            return true; // nothing to map
+        }
+
+        void* mapped = ::mmap(nullptr, (std::size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps the file alive
+        if (mapped == MAP_FAILED) { return false; }
+
+        data = (const Byte*)mapped;
+        size = (std::size_t)info.st_size;
+        return true;
+#endif
+    }
+
+    void close()
+    {
+#if !defined(_WIN32)
+        if (data != nullptr) {
+            ::munmap((void*)data, size);
+        }
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+#if defined(_WIN32)
+    Bytes fallback;
+#endif
+};
@@ -3,7 +3,8 @@
 #include "Common.h"
 
 enum OpCode : Byte {
-    OP_Constant = 1, //  two bytes: [OpCode][Constant Index]
+    OP_Constant = 1,  //  two bytes: [OpCode][Constant Index]
+    OP_Constant_Long, // four bytes: [OpCode][24-bit Constant Index, low byte first]
 
     // binary operations
     OP_Add,
@@ -13,7 +14,191 @@ enum OpCode : Byte {
 
     // unary operations
     OP_Negate,
-    OP_Return
+
+    OP_Print,
+    OP_Return,
+
+    // quickened binary operations, the VM rewrites OP_Add... into these once it has
+    // seen two numbers, they fall back to the generic opcode when the guard fails
+    OP_Add_NumNum,
+    OP_Subtract_NumNum,
+    OP_Multiply_NumNum,
+    OP_Divide_NumNum,
+
+    // superinstructions, an OP_Constant fused with the instruction after it:
+    // two bytes [OpCode][Constant Index], the constant is the (right) operand
+    OP_Add_Const,
+    OP_Subtract_Const,
+    OP_Multiply_Const,
+    OP_Divide_Const,
+    OP_Negate_Const,
+
+    // unchecked arithmetic, the compiler proved the operands are numbers (see Types.h)
+    // and the verifier checks that proof again when the chunk is loaded
+    OP_Add_Unchecked,
+    OP_Subtract_Unchecked,
+    OP_Multiply_Unchecked,
+    OP_Divide_Unchecked,
+    OP_Negate_Unchecked,
+    OP_Add_Const_Unchecked,
+    OP_Subtract_Const_Unchecked,
+    OP_Multiply_Const_Unchecked,
+    OP_Divide_Const_Unchecked,
+
+    // stack slots, two bytes: [OpCode][Slot], the slot counts from the bottom of the
+    // stack. -O2 keeps values used more than once in slots reserved at the bottom.
+    OP_Get_Slot, // pushes a copy of the slot
+    OP_Set_Slot, // copies the top into the slot, the top stays
+
+    OP_Count // number of opcodes, keep last
+};
+
+using OpCodes = std::vector<OpCode>;
+
+// static description of an instruction, used by the compiler to track the
+// stack depth and by the verifier to check a chunk before it is run
+struct OpInfo {
+    int operands; // number of operand bytes following the opcode
+    int pops;     // values taken from the stack
+    int pushes;   // values left on the stack
+};
+
+static const OpInfo op_infos[OP_Count] = {
+    { 0, 0, 0 }, // 0 is not a valid opcode
+    { 1, 0, 1 }, // OP_Constant
+    { 3, 0, 1 }, // OP_Constant_Long
+    { 0, 2, 1 }, // OP_Add
+    { 0, 2, 1 }, // OP_Subtract
+    { 0, 2, 1 }, // OP_Multiply
+    { 0, 2, 1 }, // OP_Divide
+    { 0, 1, 1 }, // OP_Negate
+    { 0, 1, 0 }, // OP_Print
+    { 0, 1, 0 }, // OP_Return
+    { 0, 2, 1 }, // OP_Add_NumNum
+    { 0, 2, 1 }, // OP_Subtract_NumNum
+    { 0, 2, 1 }, // OP_Multiply_NumNum
+    { 0, 2, 1 }, // OP_Divide_NumNum
+    { 1, 1, 1 }, // OP_Add_Const
+    { 1, 1, 1 }, // OP_Subtract_Const
+    { 1, 1, 1 }, // OP_Multiply_Const
+    { 1, 1, 1 }, // OP_Divide_Const
+    { 1, 0, 1 }, // OP_Negate_Const
+    { 0, 2, 1 }, // OP_Add_Unchecked
+    { 0, 2, 1 }, // OP_Subtract_Unchecked
+    { 0, 2, 1 }, // OP_Multiply_Unchecked
+    { 0, 2, 1 }, // OP_Divide_Unchecked
+    { 0, 1, 1 }, // OP_Negate_Unchecked
+    { 1, 1, 1 }, // OP_Add_Const_Unchecked
+    { 1, 1, 1 }, // OP_Subtract_Const_Unchecked
+    { 1, 1, 1 }, // OP_Multiply_Const_Unchecked
+    { 1, 1, 1 }, // OP_Divide_Const_Unchecked
+    { 1, 0, 1 }, // OP_Get_Slot
+    { 1, 1, 1 }, // OP_Set_Slot
 };
 
-using OpCodes = std::vector<OpCode>;
\ No newline at end of file
+static bool is_opcode(Byte byte)
+{
+    return byte > 0 && byte < OP_Count;
+}
+
+static OpInfo const& op_info(Byte op)
+{
+    assert(is_opcode(op));
+    return op_infos[op];
+}
+
+// the opcode a quickened one was rewritten from, every other opcode maps to itself
+static OpCode generic_op(Byte op)
+{
+    switch (op) {
+    case OP_Add_NumNum:      return OP_Add;
+    case OP_Subtract_NumNum: return OP_Subtract;
+    case OP_Multiply_NumNum: return OP_Multiply;
+    case OP_Divide_NumNum:   return OP_Divide;
+    default:                 return (OpCode)op;
+    }
+}
+
+// the superinstruction for OP_Constant followed by op, 0 if there is none
+static Byte fused_op(Byte op)
+{
+    switch (op) {
+    case OP_Add:                return OP_Add_Const;
+    case OP_Subtract:           return OP_Subtract_Const;
+    case OP_Multiply:           return OP_Multiply_Const;
+    case OP_Divide:             return OP_Divide_Const;
+    case OP_Negate:             return OP_Negate_Const;
+    case OP_Add_Unchecked:      return OP_Add_Const_Unchecked;
+    case OP_Subtract_Unchecked: return OP_Subtract_Const_Unchecked;
+    case OP_Multiply_Unchecked: return OP_Multiply_Const_Unchecked;
+    case OP_Divide_Unchecked:   return OP_Divide_Const_Unchecked;
+    case OP_Negate_Unchecked:   return OP_Negate_Const; // doesn't check anyway
+    default:                    return 0;
+    }
+}
+
+// the instruction a superinstruction runs after pushing its constant, 0 for other opcodes
+static Byte unfused_op(Byte op)
+{
+    switch (op) {
+    case OP_Add_Const:                return OP_Add;
+    case OP_Subtract_Const:           return OP_Subtract;
+    case OP_Multiply_Const:           return OP_Multiply;
+    case OP_Divide_Const:             return OP_Divide;
+    case OP_Negate_Const:             return OP_Negate;
+    case OP_Add_Const_Unchecked:      return OP_Add_Unchecked;
+    case OP_Subtract_Const_Unchecked: return OP_Subtract_Unchecked;
+    case OP_Multiply_Const_Unchecked: return OP_Multiply_Unchecked;
+    case OP_Divide_Const_Unchecked:   return OP_Divide_Unchecked;
+    default:                          return 0;
+    }
+}
+
+// the form of op that skips the operand checks, 0 if there is none
+static Byte unchecked_op(Byte op)
+{
+    switch (op) {
+    case OP_Add:            return OP_Add_Unchecked;
+    case OP_Subtract:       return OP_Subtract_Unchecked;
+    case OP_Multiply:       return OP_Multiply_Unchecked;
+    case OP_Divide:         return OP_Divide_Unchecked;
+    case OP_Negate:         return OP_Negate_Unchecked;
+    case OP_Add_Const:      return OP_Add_Const_Unchecked;
+    case OP_Subtract_Const: return OP_Subtract_Const_Unchecked;
+    case OP_Multiply_Const: return OP_Multiply_Const_Unchecked;
+    case OP_Divide_Const:   return OP_Divide_Const_Unchecked;
+    default:                return 0;
+    }
+}
+
+// the checked form of an unchecked op, every other opcode maps to itself
+static OpCode checked_op(Byte op)
+{
+    switch (op) {
+    case OP_Add_Unchecked:            return OP_Add;
+    case OP_Subtract_Unchecked:       return OP_Subtract;
+    case OP_Multiply_Unchecked:       return OP_Multiply;
+    case OP_Divide_Unchecked:         return OP_Divide;
+    case OP_Negate_Unchecked:         return OP_Negate;
+    case OP_Add_Const_Unchecked:      return OP_Add_Const;
+    case OP_Subtract_Const_Unchecked: return OP_Subtract_Const;
+    case OP_Multiply_Const_Unchecked: return OP_Multiply_Const;
+    case OP_Divide_Const_Unchecked:   return OP_Divide_Const;
+    default:                          return (OpCode)op;
+    }
+}
+
+static bool is_unchecked(Byte op)
+{
+    return checked_op(op) != op;
+}
+
+static bool has_constant_operand(Byte op)
+{
+    return op == OP_Constant || op == OP_Constant_Long || unfused_op(op) != 0;
+}
+
+static bool has_slot_operand(Byte op)
+{
+    return op == OP_Get_Slot || op == OP_Set_Slot;
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "Common.h"
+#include "Chunk.h"
+#include "OpCodes.h"
+#include "Value.h"
+
+// Optimizer: rewrites a compiled chunk before it is handed to the VM.
+//
+// -O0 leaves the chunk alone
+// -O1 folds arithmetic on constants, removes double negations of numbers and
+//     drops constants that are no longer referenced
+// -O2 runs the SSA middle end instead (see Ssa.h), it reuses decode and encode
+namespace Optimizer {
+
+struct Instruction {
+    OpCode op;
+    Value constant; // only used by OP_Constant / OP_Constant_Long
+    Index line;
+    Byte operand = 0; // the slot of OP_Get_Slot / OP_Set_Slot
+};
+using Instructions = std::vector<Instruction>;
+
+// what the optimizer knows about a value on the stack at compile time
+struct Slot {
+    bool constant = false;       // produced by the last OP_Constant in the output
+    bool number = false;         // always a number at runtime
+    bool negated_number = false; // produced by OP_Negate from a number
+    Value value;
+};
+
+static bool fold(OpCode op, Value a, Value b, Value& folded)
+{
+    if (!IS_NUMBER(a) || !IS_NUMBER(b)) {
+        return false; // keep the runtime error
+    }
+
+    Number x = AS_NUMBER(a);
+    Number y = AS_NUMBER(b);
+    switch (checked_op(op)) {
+    case OP_Add:      folded = x + y; return true;
+    case OP_Subtract: folded = x - y; return true;
+    case OP_Multiply: folded = x * y; return true;
+    case OP_Divide:   folded = x / y; return true;
+    default:
+        return false;
+    }
+}
+
+static Instructions decode(Chunk const& chunk)
+{
+    Instructions instructions;
+    for (Index offset = 0; offset < (Index)chunk.code.size(); /**/) {
+        auto op = (OpCode)chunk.code[offset];
+        Instruction instruction = { generic_op(op), Value{}, chunk.line_at(offset) }; // quickened code folds like the original
+        // unchecked ops stay unchecked, folding only replaces them by number constants
+        if (has_constant_operand(op)) {
+            instruction.op = OP_Constant; // re-encoded with the right width
+            instruction.constant = chunk.constants[chunk.constant_index(offset)];
+        }
+        if (has_slot_operand(op)) {
+            instruction.operand = chunk.code[offset + 1];
+        }
+        instructions.push_back(instruction);
+        if (unfused_op(op) != 0) { // superinstructions are split up again
+            instructions.push_back({ (OpCode)unfused_op(op), Value{}, instruction.line });
+        }
+        offset += 1 + op_info(op).operands;
+    }
+    return instructions;
+}
+
+// rebuilds the chunk, the fresh constant pool only holds constants still in use
+static void encode(Instructions const& instructions, Chunk& chunk, bool fuse)
+{
+    chunk.clear();
+
+    Size depth = 0;
+    Index last = -1; // offset of the last instruction written
+    for (auto const& instruction : instructions) {
+        if (fuse && chunk.fuse(last, instruction.op)) {
+            // merged into the constant before it
+        }
+        else if (instruction.op == OP_Constant) {
+            last = (Index)chunk.code.size();
+            chunk.write_constant(chunk.add_const(instruction.constant), instruction.line);
+        }
+        else {
+            last = (Index)chunk.code.size();
+            chunk.write(instruction.op, instruction.line);
+            if (has_slot_operand(instruction.op)) {
+                chunk.write(instruction.operand, instruction.line);
+            }
+        }
+
+        OpInfo const& info = op_info(instruction.op);
+        depth += info.pushes - info.pops;
+        if (depth > chunk.max_stack) { chunk.max_stack = depth; }
+    }
+}
+
+static Instructions fold_constants(Instructions const& in)
+{
+    Instructions out;
+    std::vector<Slot> stack;
+
+    for (auto const& instruction : in) {
+        switch (checked_op(instruction.op)) {
+        case OP_Constant: {
+            Slot slot;
+            slot.constant = true;
+            slot.number = IS_NUMBER(instruction.constant);
+            slot.value = instruction.constant;
+            stack.push_back(slot);
+            out.push_back(instruction);
+            break;
+        }
+
+        case OP_Add:
+        case OP_Subtract:
+        case OP_Multiply:
+        case OP_Divide: {
+            Slot b = stack.back(); stack.pop_back();
+            Slot a = stack.back(); stack.pop_back();
+
+            Value folded;
+            if (a.constant && b.constant && fold(instruction.op, a.value, b.value, folded)) {
+                // both constants are the last two instructions, replace them
+                out.pop_back();
+                out.pop_back();
+                out.push_back({ OP_Constant, folded, instruction.line });
+
+                Slot slot;
+                slot.constant = true;
+                slot.number = true;
+                slot.value = folded;
+                stack.push_back(slot);
+                break;
+            }
+
+            Slot slot;
+            slot.number = true; // or a runtime error
+            stack.push_back(slot);
+            out.push_back(instruction);
+            break;
+        }
+
+        case OP_Negate: {
+            Slot a = stack.back(); stack.pop_back();
+
+            if (a.constant && a.number) {
+                out.back() = { OP_Constant, -AS_NUMBER(a.value), instruction.line };
+                a.value = out.back().constant;
+                stack.push_back(a);
+                break;
+            }
+
+            if (a.negated_number) {
+                // -(-x) == x for numbers, drop both negations
+                out.pop_back();
+                Slot slot;
+                slot.number = true;
+                stack.push_back(slot);
+                break;
+            }
+
+            Slot slot;
+            slot.number = true;
+            slot.negated_number = a.number;
+            stack.push_back(slot);
+            out.push_back(instruction);
+            break;
+        }
+
+        default: {
+            OpInfo const& info = op_info(instruction.op);
+            stack.resize(stack.size() - info.pops);
+            stack.resize(stack.size() + info.pushes);
+            out.push_back(instruction);
+            break;
+        }
+        }
+    }
+
+    return out;
+}
+
+// fuse: emit superinstructions, see Chunk::fuse
+static void optimize(Chunk& chunk, int level, bool fuse = true)
+{
+    if (level < 1) { return; }
+
+    Instructions instructions = decode(chunk);
+    instructions = fold_constants(instructions);
+    encode(instructions, chunk, fuse);
+}
+
+}
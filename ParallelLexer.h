@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "Common.h"
+#include "Scanner.h"
+#include "Token.h"
+
+// Parallel tokenization of large sources.
+//
+// The source is cut into pieces right after a newline, so no piece starts inside
+// a comment. Every piece is scanned on its own thread, speculating that it doesn't
+// start inside a (multi-line) string either. A piece scans on past its end until
+// the first token that starts at or after it, that token tells where the next
+// piece really has to start. Since the scanner carries no state from one token to
+// the next (lines are looked up later, see LineIndex.h), the next piece is right
+// from the first of its tokens that starts at that offset. If it has no such token
+// (the speculation failed), the stitching rescans from there until the two streams
+// meet again. The result matches the sequential scanner token for token.
+namespace ParallelLexer {
+
+static const Size MIN_PIECE = 256 << 10; // smaller pieces aren't worth a thread
+
+struct Piece {
+    Index begin = 0;
+    Index end = 0;
+    std::vector<Token> tokens; // the last one starts at or after 'end' (or is the Eof)
+    std::vector<double> numbers;
+};
+
+static void scan_piece(const char* source, Size length, Piece& piece)
+{
+    Scanner scanner(source, length, piece.begin);
+    forever {
+        Token token = scanner.scan_token();
+        piece.tokens.push_back(token);
+        if (token.type == Token::Eof || token.offset >= (uint32_t)piece.end) { break; }
+    }
+    piece.numbers = std::move(scanner.numbers);
+}
+
+// cut points right after a newline, about length / count apart
+static std::vector<Piece> split(const char* source, Size length, int count)
+{
+    std::vector<Piece> pieces(1);
+    for (int n = 1; n < count; ++n) {
+        Index target = (Index)((int64_t)length * n / count);
+        if (target <= pieces.back().begin) { continue; }
+
+        auto newline = (const char*)std::memchr(source + target, '\n', (std::size_t)(length - target));
+        if (newline == nullptr) { break; }
+        Index cut = (Index)(newline - source) + 1;
+        if (cut >= length) { break; }
+        if (cut > pieces.back().begin) {
+            pieces.back().end = cut;
+            pieces.emplace_back();
+            pieces.back().begin = cut;
+        }
+    }
+    pieces.back().end = length;
+    return pieces;
+}
+
+// index of the token starting at offset, -1 if there is none
+static Index find(std::vector<Token> const& tokens, uint32_t offset)
+{
+    auto found = std::lower_bound(tokens.begin(), tokens.end(), offset,
+                                  [](Token const& token, uint32_t value) { return token.offset < value; });
+    return (found != tokens.end() && found->offset == offset) ? (Index)(found - tokens.begin()) : -1;
+}
+
+// Scans the whole source with up to 'threads' threads into scanner.scanned (the
+// Eof included) and scanner.numbers, scan_token() then just hands them out.
+static void scan(Scanner& scanner, int threads, Size min_piece = MIN_PIECE)
+{
+    const char* source = scanner.source;
+    const Size length = (Size)(scanner.end - scanner.source);
+
+    int count = std::max(1, std::min(threads, length / min_piece));
+    std::vector<Piece> pieces = split(source, length, count);
+
+    std::vector<std::thread> workers;
+    for (std::size_t n = 1; n < pieces.size(); ++n) {
+        workers.emplace_back(scan_piece, source, length, std::ref(pieces[n]));
+    }
+    scan_piece(source, length, pieces[0]);
+    for (auto& worker : workers) { worker.join(); }
+
+    std::vector<Token>& out = scanner.scanned;
+    out.clear();
+    scanner.numbers.clear();
+    scanner.number_indices.clear();
+    out.reserve(pieces.size() * pieces[0].tokens.size() + 1);
+
+    // number literals get renumbered, past the limit they are errors like in Scanner::make_number
+    auto emit = [&](Token token, std::vector<double> const& values) {
+        if (token.type == Token::Number) {
+            uint32_t index = scanner.add_number(values[token.literal]);
+            if (index == Scanner::NO_NUMBER) {
+                token.type = Token::Error;
+                token.literal = Scanner::TooManyNumbers;
+            }
+            else {
+                token.literal = index;
+            }
+        }
+        out.push_back(token);
+    };
+
+    Token next = pieces[0].tokens[0]; // where the stream continues
+    for (auto const& piece : pieces) {
+        Index first = find(piece.tokens, next.offset);
+        if (first < 0) {
+            // the piece started inside a string, scan sequentially until both agree again
+            Scanner rescan(source, length, (Index)next.offset);
+            forever {
+                Token token = rescan.scan_token();
+                if (token.type == Token::Eof || token.offset >= (uint32_t)piece.end) {
+                    next = token;
+                    break;
+                }
+                first = find(piece.tokens, token.offset);
+                if (first >= 0) { break; }
+                emit(token, rescan.numbers);
+            }
+            if (first < 0) { continue; } // rescanned the whole piece
+        }
+
+        for (Index n = first; n < (Index)piece.tokens.size() - 1; ++n) {
+            emit(piece.tokens[n], piece.numbers);
+        }
+        next = piece.tokens.back();
+    }
+    out.push_back(next); // the Eof
+
+    scanner.next_scanned = 0;
+    scanner.current = scanner.end;
+}
+
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+#include "Chunk.h"
+#include "Debug.h"
+#include "OpCodes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_RDTSC
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define PROFILER_RDTSC
+#else
+#include <chrono>
+#endif
+
+// Opcode profiler, only built with PROFILE_OPCODES (see Common.h). VM::run calls
+// step() before every instruction, every step closes the previous instruction and
+// charges the time since its start to its opcode and to its source line. Without
+// PROFILE_OPCODES the VM doesn't even have a Profile, the hooks compile to nothing.
+namespace Profiler {
+
+#if defined(PROFILER_RDTSC)
+static const char* const UNIT = "cycles";
+
+static inline uint64_t now()
+{
+    return __rdtsc();
+}
+#else
+static const char* const UNIT = "ns";
+
+static inline uint64_t now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+struct Counter {
+    uint64_t count = 0;
+    uint64_t ticks = 0;
+};
+
+struct Profile {
+    Counter ops[OP_Count];
+    std::vector<Counter> lines; // by source line
+
+    Byte running = 0; // opcode started at 'started', 0 when nothing runs
+    Index running_line = 0;
+    Index run = 0; // line run of the last instruction
+    uint64_t started = 0;
+
+    void step(ChunkView const& chunk, const Byte* ip)
+    {
+        uint64_t time = now();
+        charge(time);
+
+        Index offset = (Index)(ip - chunk.code);
+        running = *ip;
+        running_line = line_at(chunk, offset);
+        if ((Size)lines.size() <= running_line) { lines.resize(running_line + 1); }
+
+        ops[running].count++;
+        lines[running_line].count++;
+        started = time;
+    }
+
+    // the running instruction turned into op (a failed guard), it still counts once
+    void relabel(Byte op)
+    {
+        ops[running].count--;
+        ops[op].count++;
+        running = op;
+    }
+
+    // the run ended (return or runtime error)
+    void stop()
+    {
+        charge(now());
+        running = 0;
+        run = 0;
+    }
+
+    void charge(uint64_t time)
+    {
+        if (running == 0) { return; }
+        ops[running].ticks += time - started;
+        lines[running_line].ticks += time - started;
+    }
+
+    // the line runs are searched from the last one, code mostly runs forward
+    Index line_at(ChunkView const& chunk, Index offset)
+    {
+        if (run >= chunk.line_count || chunk.lines[run].offset > offset) { run = 0; }
+        while (run + 1 < chunk.line_count && chunk.lines[run + 1].offset <= offset) { run++; }
+        return chunk.lines[run].line;
+    }
+
+    uint64_t total_ticks() const
+    {
+        uint64_t total = 0;
+        for (auto const& op : ops) { total += op.ticks; }
+        return total;
+    }
+
+    // indices of the non empty counters, most expensive first
+    static Indices ranked(Counter const* counters, Size count)
+    {
+        Indices order;
+        for (Index n = 0; n < count; ++n) {
+            if (counters[n].count > 0) { order.push_back(n); }
+        }
+        std::sort(order.begin(), order.end(), [&](Index a, Index b) { return counters[a].ticks > counters[b].ticks; });
+        return order;
+    }
+
+    void report(std::FILE* out, Size top_lines = 10) const
+    {
+        double total = (double)std::max<uint64_t>(total_ticks(), 1);
+        Indices order = ranked(ops, OP_Count);
+        int width = 18; // the first column fits the longest opcode name
+        for (Index op : order) { width = std::max(width, (int)std::strlen(Debug::op_name((Byte)op))); }
+
+        std::fprintf(out, "%-*s %12s %14s %10s %7s\n", width, "opcode", "count", UNIT, "per exec", "share");
+        for (Index op : order) {
+            Counter const& c = ops[op];
+            std::fprintf(out, "%-*s %12llu %14llu %10.1f %6.2f%%\n", width, Debug::op_name((Byte)op),
+                         (unsigned long long)c.count, (unsigned long long)c.ticks,
+                         (double)c.ticks / c.count, 100.0 * c.ticks / total);
+        }
+
+        std::fprintf(out, "\n%-*s %12s %14s %10s %7s\n", width, "line", "count", UNIT, "per exec", "share");
+        Indices hot = ranked(lines.data(), (Size)lines.size());
+        for (Index n = 0; n < (Index)hot.size() && n < top_lines; ++n) {
+            Counter const& c = lines[hot[n]];
+            std::fprintf(out, "%-*d %12llu %14llu %10.1f %6.2f%%\n", width, hot[n],
+                         (unsigned long long)c.count, (unsigned long long)c.ticks,
+                         (double)c.ticks / c.count, 100.0 * c.ticks / total);
+        }
+    }
+
+    bool write_csv(std::string const& path) const
+    {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (file == nullptr) { return false; }
+
+        std::fprintf(file, "kind,key,count,%s\n", UNIT);
+        for (Index op : ranked(ops, OP_Count)) {
+            std::fprintf(file, "opcode,%s,%llu,%llu\n", Debug::op_name((Byte)op),
+                         (unsigned long long)ops[op].count, (unsigned long long)ops[op].ticks);
+        }
+        for (Index line : ranked(lines.data(), (Size)lines.size())) {
+            std::fprintf(file, "line,%d,%llu,%llu\n", line,
+                         (unsigned long long)lines[line].count, (unsigned long long)lines[line].ticks);
+        }
+        return std::fclose(file) == 0;
+    }
+
+    bool write_json(std::string const& path) const
+    {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (file == nullptr) { return false; }
+
+        std::fprintf(file, "{\n  \"unit\": \"%s\",\n  \"opcodes\": [", UNIT);
+        const char* separator = "\n";
+        for (Index op : ranked(ops, OP_Count)) {
+            std::fprintf(file, "%s    { \"opcode\": \"%s\", \"count\": %llu, \"%s\": %llu }", separator,
+                         Debug::op_name((Byte)op), (unsigned long long)ops[op].count, UNIT, (unsigned long long)ops[op].ticks);
+            separator = ",\n";
+        }
+        std::fprintf(file, "\n  ],\n  \"lines\": [");
+        separator = "\n";
+        for (Index line : ranked(lines.data(), (Size)lines.size())) {
+            std::fprintf(file, "%s    { \"line\": %d, \"count\": %llu, \"%s\": %llu }", separator,
+                         line, (unsigned long long)lines[line].count, UNIT, (unsigned long long)lines[line].ticks);
+            separator = ",\n";
+        }
+        std::fprintf(file, "\n  ]\n}\n");
+        return std::fclose(file) == 0;
+    }
+};
+
+}
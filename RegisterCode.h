@@ -0,0 +1,201 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "Common.h"
+#include "Chunk.h"
+#include "Value.h"
+
+// Register tier: an alternative to the stack byte code in OpCodes.h. Instructions
+// are three-address ops on the virtual registers of a frame, R[a] = R[b] + K[c]
+// and the like, so an operation reads its operands and writes its result directly
+// instead of pushing and popping them. Number literals are never loaded on their
+// own, they stay constant operands (K) until an instruction needs them in a
+// register. The Compiler emits it from the same parser (see RegisterEmitter) and
+// VM::run_registers executes it.
+enum RegOp : Byte {
+    R_LoadK = 1,  // R[a] = K[b | c << 8]
+
+    R_Add,        // R[a] = R[b] + R[c]
+    R_Subtract,
+    R_Multiply,
+    R_Divide,
+
+    R_Add_RK,     // R[a] = R[b] + K[c]
+    R_Subtract_RK,
+    R_Multiply_RK,
+    R_Divide_RK,
+
+    R_Subtract_KR, // R[a] = K[b] - R[c], + and * swap their operands into _RK instead
+    R_Divide_KR,
+
+    R_Negate,     // R[a] = -R[b]
+
+    R_Print,      // print R[a]
+    R_Return,     // return R[a]
+
+    R_Count // number of register ops, keep last
+};
+
+struct RegInstr {
+    Byte op;
+    Byte a;
+    Byte b;
+    Byte c;
+};
+static_assert(sizeof(RegInstr) == 4, "register instructions are one 32-bit word");
+
+static const Size MAX_REGISTERS = 256; // a register number is one byte
+static const Size MAX_REGISTER_CONSTANTS = 1 << 16; // R_LoadK takes a 16-bit index
+
+struct RegisterChunk {
+    std::vector<RegInstr> code;
+    LineRuns lines; // one entry per instruction, not per byte
+    Values constants;
+    std::unordered_map<Value, Index, ValueHash, ValueIdentical> constant_indices;
+    Size frame_size = 0; // registers the code uses
+
+    void write(RegInstr instruction, Index line)
+    {
+        if (lines.empty() || lines.back().line != line) {
+            lines.push_back({ (Index)code.size(), line });
+        }
+        code.push_back(instruction);
+    }
+
+    Index add_const(Value value)
+    {
+        auto found = constant_indices.find(value);
+        if (found != constant_indices.end()) {
+            return found->second;
+        }
+
+        constants.push_back(value);
+        Index index = (Index)constants.size() - 1;
+        constant_indices.emplace(value, index);
+        return index;
+    }
+
+    Index line_at(Index instruction) const
+    {
+        auto after = std::upper_bound(lines.begin(), lines.end(), instruction, [](Index o, LineRun const& run) {
+            return o < run.offset;
+        });
+        assert(after != lines.begin());
+        return (after - 1)->line;
+    }
+
+    void clear()
+    {
+        code.clear();
+        lines.clear();
+        constants.clear();
+        constant_indices.clear();
+        frame_size = 0;
+    }
+};
+
+// where the value of a compiled expression is: a register or still a constant
+struct Operand {
+    enum Kind : Byte { Register, Constant };
+    Kind kind = Constant;
+    Index index = 0; // register number or constant index
+};
+
+// Register allocation follows the expression nesting like a stack: every value
+// still needed lives in the lowest free register, an operation leaves its result
+// in the lower of its operand registers and frees the other one.
+struct RegisterEmitter {
+    RegisterChunk* chunk = nullptr;
+    Size free_register = 0; // first unused register
+    const char* error = nullptr; // set when the code doesn't fit the format
+
+    void start(RegisterChunk& target)
+    {
+        chunk = &target;
+        chunk->clear();
+        free_register = 0;
+        error = nullptr;
+    }
+
+    Operand constant(Value value)
+    {
+        Index index = chunk->add_const(value);
+        if (index >= MAX_REGISTER_CONSTANTS) {
+            error = "Too many constants for the register tier.";
+            index = 0;
+        }
+        return { Operand::Constant, index };
+    }
+
+    Byte allocate()
+    {
+        if (free_register >= MAX_REGISTERS) {
+            error = "Expression needs too many registers.";
+            return 0;
+        }
+        if (++free_register > chunk->frame_size) { chunk->frame_size = free_register; }
+        return (Byte)(free_register - 1);
+    }
+
+    void emit(RegOp op, Index a, Index b, Index c, Index line)
+    {
+        chunk->write({ (Byte)op, (Byte)a, (Byte)b, (Byte)c }, line);
+    }
+
+    Byte to_register(Operand operand, Index line)
+    {
+        if (operand.kind == Operand::Register) {
+            return (Byte)operand.index;
+        }
+        Byte target = allocate();
+        emit(R_LoadK, target, operand.index & 0xff, operand.index >> 8, line);
+        return target;
+    }
+
+    // op is one of R_Add, R_Subtract, R_Multiply, R_Divide
+    Operand binary(RegOp op, Operand left, Operand right, Index line)
+    {
+        const int offset = op - R_Add; // to the _RK form
+        const bool commutative = (op == R_Add || op == R_Multiply);
+
+        if (left.kind == Operand::Constant && right.kind == Operand::Register && left.index <= UINT8_MAX) {
+            if (commutative) {
+                emit((RegOp)(R_Add_RK + offset), right.index, right.index, left.index, line);
+            }
+            else {
+                emit(op == R_Subtract ? R_Subtract_KR : R_Divide_KR, right.index, left.index, right.index, line);
+            }
+            return right;
+        }
+
+        if (right.kind == Operand::Constant && right.index <= UINT8_MAX) {
+            Byte a = to_register(left, line);
+            emit((RegOp)(R_Add_RK + offset), a, a, right.index, line);
+            free_register = a + 1;
+            return { Operand::Register, a };
+        }
+
+        // constants that don't fit an operand byte are loaded as well
+        Byte b = to_register(left, line);
+        Byte c = to_register(right, line);
+        Byte a = std::min(b, c);
+        emit(op, a, b, c, line);
+        free_register = a + 1;
+        return { Operand::Register, a };
+    }
+
+    Operand negate(Operand operand, Index line)
+    {
+        Byte a = to_register(operand, line);
+        emit(R_Negate, a, a, 0, line);
+        return { Operand::Register, a };
+    }
+
+    // print or return the value of a whole expression, all registers are free again after it
+    void finish(RegOp op, Operand operand, Index line)
+    {
+        emit(op, to_register(operand, line), 0, 0, line);
+        free_register = 0;
+    }
+};
@@ -1,17 +1,132 @@
 #pragma once
 
-#include <cctype> // for std::isdigit
+#include <algorithm> // for std::find, std::find_if
+#include <charconv> // for std::from_chars
+#include <cmath> // for HUGE_VAL
+#include <cstring> // for std::strlen, std::memcmp, std::memcpy
+#include "Common.h"
+#include "Keywords.h"
+#include "LineIndex.h"
+#include "ScannerSimd.h"
 #include "Token.h"
 
+// Index of every distinct literal value in Scanner::numbers, keyed by its bit
+// pattern. Open addressing with linear probing, a std::unordered_map made the
+// scanner several times slower on literal heavy input.
+struct NumberIndex {
+    struct Slot {
+        uint64_t bits;
+        uint32_t index; // EMPTY when unused
+    };
+    static const uint32_t EMPTY = UINT32_MAX;
+
+    std::vector<Slot> slots;
+    std::size_t used = 0;
+    int shift = 64; // 64 - log2(slots.size())
+
+    // the index stored for bits, or 'index' which is stored for it from now on
+    uint32_t find_or_add(uint64_t bits, uint32_t index)
+    {
+        if ((used + 1) * 2 > slots.size()) { grow(); }
+
+        Slot* slot = probe(bits);
+        if (slot->index != EMPTY) {
+            return slot->index;
+        }
+        *slot = { bits, index };
+        used++;
+        return index;
+    }
+
+    Slot* probe(uint64_t bits)
+    {
+        // the top bits of the product: short literals only differ in the high bits of a double
+        const std::size_t mask = slots.size() - 1;
+        std::size_t at = (std::size_t)((bits * 0x9e3779b97f4a7c15ull) >> shift);
+        while (slots[at].index != EMPTY && slots[at].bits != bits) { at = (at + 1) & mask; }
+        return &slots[at];
+    }
+
+    void grow()
+    {
+        std::vector<Slot> old = std::move(slots);
+        slots.assign(std::max<std::size_t>(64, old.size() * 2), Slot{ 0, EMPTY });
+        shift = 64;
+        for (std::size_t size = slots.size(); size > 1; size >>= 1) { shift--; }
+        for (Slot const& slot : old) {
+            if (slot.index != EMPTY) { *probe(slot.bits) = slot; }
+        }
+    }
+
+    void clear()
+    {
+        slots.clear();
+        used = 0;
+        shift = 64;
+    }
+};
+
 struct Scanner {
+    const char* source;
     const char* start;
     const char* current;
-    int line = 1;
+    const char* end; // the source doesn't need a terminating '\0'
+    std::vector<double> numbers; // decoded Number literals, see Token::literal
+    NumberIndex number_indices; // every value is stored once
+    LineIndex lines;
 
-    Scanner(const char* src) : start(src), current(src) {}
+    // tokens scanned ahead of time (see ParallelLexer.h), handed out before anything else
+    std::vector<Token> scanned;
+    std::size_t next_scanned = 0;
+
+    // messages of the Error tokens, their Token::literal is the index
+    enum ScanError : uint32_t { UnexpectedCharacter, UnterminatedString, TooManyNumbers };
+    static constexpr const char* errors[] = { "Unexpected character!", "Unterminated string.", "Too many number literals." };
+
+    Scanner(const char* src) : Scanner(src, (int)std::strlen(src)) {}
+    Scanner(const char* src, int length) : Scanner(src, length, 0) {}
+
+    // starts scanning at offset 'begin', the token offsets stay relative to 'src'
+    Scanner(const char* src, int length, int begin)
+        : source(src), start(src + begin), current(src + begin), end(src + length), lines(src, (std::size_t)length) {}
+
+    static const char* message(Token const& error)
+    {
+        return errors[error.literal];
+    }
+
+    static const uint32_t NO_NUMBER = UINT32_MAX;
+
+    // index of the value in numbers, NO_NUMBER when it's a new one past the 24-bit Token::literal
+    uint32_t add_number(double number)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &number, sizeof(bits));
+        const uint32_t next = (uint32_t)numbers.size();
+        uint32_t index = number_indices.find_or_add(bits, next);
+        if (index == next) {
+            if (next > 0xffffff) { return NO_NUMBER; } // numbers stops growing, so new values keep ending up here
+            numbers.push_back(number);
+        }
+        return index;
+    }
+
+    const char* lexeme(Token const& token) const
+    {
+        return source + token.offset;
+    }
+
+    Index line_of(Token const& token)
+    {
+        return lines.line(token.offset);
+    }
 
     Token scan_token()
     {
+        if (next_scanned < scanned.size()) {
+            return scanned[next_scanned++];
+        }
+
         skip_whitespace();
 
         start = current;
@@ -23,8 +138,8 @@ struct Scanner {
         char c = advance();
 
         // handle numbers and identifier first
-        if (std::isalpha(c)) { return make_identifier(); }
-        if (std::isdigit(c)) { return make_number(); }
+        if (CharClass::is_alpha(c)) { return make_identifier(); }
+        if (CharClass::is_digit(c)) { return make_number(); }
 
         switch (c) {
         // one-char lexeme
@@ -69,33 +184,30 @@ struct Scanner {
             break;
         }
 
-        return error_token("Unexpected character!");
+        return error_token(UnexpectedCharacter);
     }
 
     bool eof() const
     {
-        return *current == '\0';
+        return current >= end;
     }
 
     Token make_token(Token::Type type)
     {
         Token token;
+        token.offset = (uint32_t)(start - source);
+        token.length = (uint32_t)(current - start);
         token.type = type;
-        token.start = start;
-        token.length = (int)(current - start);
-        token.line = line;
+        token.literal = 0;
 
         return token;
     }
 
-    Token error_token(const char* msg)
+    // the token covers the offending characters
+    Token error_token(ScanError error)
     {
-        Token token;
-        token.type = Token::Error;
-        token.start = msg;
-        token.length = (int)std::strlen(msg);
-        token.line = line;
-
+        Token token = make_token(Token::Error);
+        token.literal = error;
         return token;
     }
 
@@ -117,30 +229,13 @@ struct Scanner {
     void skip_whitespace()
     {
         forever {
-            char c = peek();
-            switch (c) {
-            case ' ':
-            case '\r':
-            case '\t':
-                advance();
-                break;
-
-            case '\n':
-                line++;
-                advance();
-                break;
-
-            case '/':
-                if (peek_next() == '/') {
-                    // A comment goes until the end of the line.
-                    while (peek() != '\n' && !eof()) { advance(); }
-                }
-                else {
-                    return;
-                }
-                break;
-
-            default:
+            current = ScanLoops::skip_whitespace(current, end);
+
+            if (peek() == '/' && peek_next() == '/') {
+                // A comment goes until the end of the line.
+                current = ScanLoops::skip_comment(current, end);
+            }
+            else {
                 return;
             }
         }
@@ -148,111 +243,74 @@ struct Scanner {
 
     char peek()
     {
+        if (eof()) { return '\0'; }
         return *current;
     }
 
     char peek_next()
     {
-        if (eof()) { return '\0'; }
+        if (current + 1 >= end) { return '\0'; }
         return current[1];
     }
 
     Token make_string()
     {
-        while (peek() != '"' && !eof()) {
-            if (peek() == '\n') { line++; }
-            advance();
-        }
+        current = ScanLoops::skip_string(current, end);
 
-        if (eof()) { return error_token("Unterminated string."); }
+        if (eof()) { return error_token(UnterminatedString); }
 
         // the closing '"'
         advance();
         return make_token(Token::String);
     }
 
+    // the literal is decoded right here, so the compiler doesn't have to rescan it
     Token make_number()
     {
-        while (std::isdigit(peek())) { advance(); }
+        // the first digit was already consumed by scan_token
+        uint64_t integer = (uint64_t)(start[0] - '0');
+        while (CharClass::is_digit(peek())) {
+            integer = integer * 10 + (uint64_t)(advance() - '0'); // may wrap, only used for short literals
+        }
+        bool exact = (current - start) <= 15; // below 2^53, so the double is exact
 
         // Look for a fractional part.
-        if (peek() == '.' && std::isdigit(peek_next())) {
+        if (peek() == '.' && CharClass::is_digit(peek_next())) {
             // Consume the "."
             advance();
 
-            while (std::isdigit(peek())) { advance(); }
+            while (CharClass::is_digit(peek())) { advance(); }
+            exact = false;
+        }
+
+        double number = (double)integer;
+        if (!exact) {
+            // correctly rounded, locale independent and bounded by the token
+            auto result = std::from_chars(start, current, number);
+            if (result.ec == std::errc::result_out_of_range) {
+                // without an exponent a literal with a nonzero integer part overflows, others underflow (as strtod)
+                const char* dot = std::find(start, current, '.');
+                bool large = std::find_if(start, dot, [](char c) { return c != '0'; }) != dot;
+                number = large ? HUGE_VAL : 0.0;
+            }
         }
 
-        return make_token(Token::Number);
+        uint32_t index = add_number(number);
+        if (index == NO_NUMBER) { return error_token(TooManyNumbers); }
+        Token token = make_token(Token::Number);
+        token.literal = index;
+        return token;
     }
 
     Token make_identifier()
     {
-        while (std::isalpha(peek()) || std::isdigit(peek())) {
-            advance();
-        }
+        current = ScanLoops::skip_identifier(current, end);
 
         return make_token(identifier_type());
     }
 
     Token::Type identifier_type()
     {
-        switch (start[0]) {
-        case 'a':
-            return check_keyword(1, 2, "nd", Token::And);
-        case 'c':
-            return check_keyword(1, 4, "lass", Token::Class);
-        case 'e':
-            return check_keyword(1, 3, "lse", Token::Else);
-        case 'f':
-            if (current - start > 1) {
-                switch (start[1]) {
-                case 'a':
-                    return check_keyword(2, 3, "lse", Token::False);
-                case 'o':
-                    return check_keyword(2, 1, "r", Token::For);
-                case 'u':
-                    return check_keyword(2, 1, "n", Token::Fun);
-                }
-            }
-            break;
-        case 'i':
-            return check_keyword(1, 1, "f", Token::If);
-        case 'n':
-            return check_keyword(1, 2, "il", Token::Nil);
-        case 'o':
-            return check_keyword(1, 1, "r", Token::Or);
-        case 'p':
-            return check_keyword(1, 4, "rint", Token::Print);
-        case 'r':
-            return check_keyword(1, 5, "eturn", Token::Return);
-        case 's':
-            return check_keyword(1, 4, "uper", Token::Super);
-        case 't':
-            if (current - start > 1) {
-                switch (start[1]) {
-                case 'h':
-                    return check_keyword(2, 2, "is", Token::This);
-                case 'r':
-                    return check_keyword(2, 2, "ue", Token::True);
-                }
-            }
-            break;
-        case 'v':
-            return check_keyword(1, 2, "ar", Token::Var);
-        case 'w':
-            return check_keyword(1, 4, "hile", Token::While);
-        }
-
-        return Token::Identifier;
-    }
-
-    Token::Type check_keyword(int begin, int length, const char* rest, Token::Type type)
-    {
-        if ((int)(current - start) == begin + length && std::memcmp(start + begin, rest, length) == 0) {
-            return type;
-        }
-
-        return Token::Identifier;
+        return Keywords::lookup(start, (std::size_t)(current - start));
     }
 };
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstdint>
+
+// Character classes and the hot loops of the scanner.
+//
+// Every loop exists as a scalar version driven by a 256 entry class table and,
+// on x86-64, as a vector version that looks at 16 (SSE2) or 32 (AVX2, when the
+// compiler targets it) bytes at once. NO_SIMD_SCANNER forces the scalar loops.
+// The vector loops only run while a full vector fits before 'end', the rest is
+// done by the scalar loop, so the source never has to be padded.
+
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(NO_SIMD_SCANNER)
+#define SIMD_SCANNER
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace CharClass {
+
+enum : uint8_t {
+    Alpha   = 1 << 0, // a-z A-Z _
+    Digit   = 1 << 1, // 0-9
+    Space   = 1 << 2, // ' ' \t \r
+    Newline = 1 << 3, // \n
+};
+
+struct Table {
+    uint8_t classes[256];
+};
+
+static constexpr Table make_table()
+{
+    Table table = {};
+    for (int c = 'a'; c <= 'z'; ++c) { table.classes[c] |= Alpha; }
+    for (int c = 'A'; c <= 'Z'; ++c) { table.classes[c] |= Alpha; }
+    for (int c = '0'; c <= '9'; ++c) { table.classes[c] |= Digit; }
+    table.classes[(int)'_'] |= Alpha;
+    table.classes[(int)' '] |= Space;
+    table.classes[(int)'\t'] |= Space;
+    table.classes[(int)'\r'] |= Space;
+    table.classes[(int)'\n'] |= Newline;
+    return table;
+}
+
+static constexpr Table table = make_table();
+
+static inline bool is(char c, uint8_t classes)
+{
+    return (table.classes[(uint8_t)c] & classes) != 0;
+}
+
+static inline bool is_alpha(char c) { return is(c, Alpha); }
+static inline bool is_digit(char c) { return is(c, Digit); }
+
+}
+
+namespace ScanLoops {
+
+#if defined(SIMD_SCANNER)
+
+static inline int lowest_bit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// the few vector operations the loops need, one wrapper per register width
+struct Vec128 {
+    static constexpr int width = 16;
+    __m128i v;
+
+    static Vec128 load(const char* p) { return { _mm_loadu_si128((const __m128i*)p) }; }
+    static Vec128 splat(char c) { return { _mm_set1_epi8(c) }; }
+
+    Vec128 operator==(Vec128 o) const { return { _mm_cmpeq_epi8(v, o.v) }; }
+    Vec128 operator|(Vec128 o) const { return { _mm_or_si128(v, o.v) }; }
+    Vec128 operator&(Vec128 o) const { return { _mm_and_si128(v, o.v) }; }
+    Vec128 operator>(Vec128 o) const { return { _mm_cmpgt_epi8(v, o.v) }; } // signed
+    Vec128 operator<(Vec128 o) const { return { _mm_cmplt_epi8(v, o.v) }; } // signed
+    uint32_t mask() const { return (uint32_t)_mm_movemask_epi8(v); }
+};
+
+#if defined(__AVX2__)
+struct Vec256 {
+    static constexpr int width = 32;
+    __m256i v;
+
+    static Vec256 load(const char* p) { return { _mm256_loadu_si256((const __m256i*)p) }; }
+    static Vec256 splat(char c) { return { _mm256_set1_epi8(c) }; }
+
+    Vec256 operator==(Vec256 o) const { return { _mm256_cmpeq_epi8(v, o.v) }; }
+    Vec256 operator|(Vec256 o) const { return { _mm256_or_si256(v, o.v) }; }
+    Vec256 operator&(Vec256 o) const { return { _mm256_and_si256(v, o.v) }; }
+    Vec256 operator>(Vec256 o) const { return { _mm256_cmpgt_epi8(v, o.v) }; }
+    Vec256 operator<(Vec256 o) const { return { _mm256_cmpgt_epi8(o.v, v) }; }
+    uint32_t mask() const { return (uint32_t)_mm256_movemask_epi8(v); }
+};
+using Vec = Vec256;
+#else
+using Vec = Vec128;
+#endif
+
+static const uint32_t ALL = (Vec::width == 32) ? 0xffffffffu : 0xffffu;
+
+// lo <= c <= hi, signed compares are fine for the ascii ranges we need
+static inline Vec in_range(Vec chars, char lo, char hi)
+{
+    return (chars > Vec::splat(lo - 1)) & (chars < Vec::splat(hi + 1));
+}
+
+#endif
+
+// skips ' ', \t, \r and \n
+static inline const char* skip_whitespace(const char* p, const char* end)
+{
+#if defined(SIMD_SCANNER)
+    while (end - p >= Vec::width) {
+        Vec chars = Vec::load(p);
+        uint32_t blank = ((chars == Vec::splat(' '))
+            | (chars == Vec::splat('\n'))
+            | (chars == Vec::splat('\t'))
+            | (chars == Vec::splat('\r'))).mask();
+
+        if (blank != ALL) {
+            return p + lowest_bit(~blank);
+        }
+        p += Vec::width;
+    }
+#endif
+    while (p < end && CharClass::is(*p, CharClass::Space | CharClass::Newline)) { ++p; }
+    return p;
+}
+
+// end of a // comment: the next '\n' (not consumed) or the end of the source
+static inline const char* skip_comment(const char* p, const char* end)
+{
+#if defined(SIMD_SCANNER)
+    while (end - p >= Vec::width) {
+        uint32_t newlines = (Vec::load(p) == Vec::splat('\n')).mask();
+        if (newlines != 0) {
+            return p + lowest_bit(newlines);
+        }
+        p += Vec::width;
+    }
+#endif
+    while (p < end && *p != '\n') { ++p; }
+    return p;
+}
+
+// first character that can't continue an identifier
+static inline const char* skip_identifier(const char* p, const char* end)
+{
+#if defined(SIMD_SCANNER)
+    while (end - p >= Vec::width) {
+        Vec chars = Vec::load(p);
+        Vec letters = in_range(chars | Vec::splat(0x20), 'a', 'z'); // folds upper into lower case
+        uint32_t word = (letters | in_range(chars, '0', '9') | (chars == Vec::splat('_'))).mask();
+        if (word != ALL) {
+            return p + lowest_bit(~word);
+        }
+        p += Vec::width;
+    }
+#endif
+    while (p < end && CharClass::is(*p, CharClass::Alpha | CharClass::Digit)) { ++p; }
+    return p;
+}
+
+// the closing '"' of a string (or the end of the source)
+static inline const char* skip_string(const char* p, const char* end)
+{
+#if defined(SIMD_SCANNER)
+    while (end - p >= Vec::width) {
+        uint32_t quotes = (Vec::load(p) == Vec::splat('"')).mask();
+        if (quotes != 0) {
+            return p + lowest_bit(quotes);
+        }
+        p += Vec::width;
+    }
+#endif
+    while (p < end && *p != '"') { ++p; }
+    return p;
+}
+
+}
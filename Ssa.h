@@ -0,0 +1,481 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Common.h"
+#include "Chunk.h"
+#include "OpCodes.h"
+#include "Optimizer.h"
+#include "Types.h"
+#include "Value.h"
+
+// SSA middle end for -O2: a chunk is lifted into a list of nodes, every node but
+// print and return defines one value (v<index>) from values defined before it.
+// Scripts are straight line code, so there are no blocks and no phis. The passes
+// each copy the nodes in order into a new function and lower() turns the result
+// back into stack byte code, values with more than one user are kept in stack
+// slots (OP_Get_Slot / OP_Set_Slot) so they are computed once.
+//
+// Nothing that can fail at runtime is dropped or reordered: the rewrites that
+// remove an operation need operands typed as numbers or an identical operation
+// before it, which would have failed first, and a value typed as a
+// number is still computed by checked arithmetic that can fail on the way, so
+// two such operands are never swapped. The runtime errors and the output before
+// them stay the same.
+namespace Ssa {
+
+enum class Op : Byte {
+    Constant,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Negate,
+    Print,
+    Return,
+};
+
+static const Index NONE = -1;
+
+struct Node {
+    Op op = Op::Constant;
+    bool checked = true;      // arithmetic: checks its operands at runtime
+    Index a = NONE, b = NONE; // operands, values defined by earlier nodes
+    Value constant;           // Op::Constant
+    Index line = 0;
+    StaticType type = StaticType::Unknown; // of the value the node defines
+};
+
+struct Function {
+    std::vector<Node> nodes;
+};
+
+static bool is_arithmetic(Op op)
+{
+    return op >= Op::Add && op <= Op::Negate;
+}
+
+static OpCode opcode(Node const& node)
+{
+    OpCode op;
+    switch (node.op) {
+    case Op::Add:      op = OP_Add;      break;
+    case Op::Subtract: op = OP_Subtract; break;
+    case Op::Multiply: op = OP_Multiply; break;
+    case Op::Divide:   op = OP_Divide;   break;
+    case Op::Negate:   op = OP_Negate;   break;
+    case Op::Print:    return OP_Print;
+    case Op::Return:   return OP_Return;
+    default:           return OP_Constant;
+    }
+    return node.checked ? op : (OpCode)unchecked_op(op);
+}
+
+static const char* op_name(Op op)
+{
+    switch (op) {
+    case Op::Constant: return "const";
+    case Op::Add:      return "add";
+    case Op::Subtract: return "sub";
+    case Op::Multiply: return "mul";
+    case Op::Divide:   return "div";
+    case Op::Negate:   return "neg";
+    case Op::Print:    return "print";
+    case Op::Return:   return "return";
+    default:           return "?";
+    }
+}
+
+static Function lift(Chunk const& chunk)
+{
+    Function function;
+    std::vector<Index> stack; // value on each stack slot
+
+    for (auto const& instruction : Optimizer::decode(chunk)) {
+        // slot copies only move values around
+        if (instruction.op == OP_Get_Slot) {
+            stack.push_back(stack[instruction.operand]);
+            continue;
+        }
+        if (instruction.op == OP_Set_Slot) {
+            stack[instruction.operand] = stack.back();
+            continue;
+        }
+
+        Node node;
+        node.line = instruction.line;
+        node.checked = !is_unchecked(instruction.op);
+
+        switch (checked_op(instruction.op)) {
+        case OP_Constant:
+            node.op = Op::Constant;
+            node.constant = instruction.constant;
+            node.type = Types::type_of(instruction.constant);
+            break;
+        case OP_Add:      node.op = Op::Add;      break;
+        case OP_Subtract: node.op = Op::Subtract; break;
+        case OP_Multiply: node.op = Op::Multiply; break;
+        case OP_Divide:   node.op = Op::Divide;   break;
+        case OP_Negate:   node.op = Op::Negate;   break;
+        case OP_Print:    node.op = Op::Print;    break;
+        case OP_Return:   node.op = Op::Return;   break;
+        default:
+            assert(false && "opcode without an IR node");
+            break;
+        }
+
+        OpInfo const& info = op_info(instruction.op);
+        if (info.pops == 2) { node.b = stack.back(); stack.pop_back(); }
+        if (info.pops >= 1) { node.a = stack.back(); stack.pop_back(); }
+        if (is_arithmetic(node.op)) { node.type = StaticType::Number; } // or a runtime error before it
+
+        function.nodes.push_back(node);
+        if (info.pushes == 1) { stack.push_back((Index)function.nodes.size() - 1); }
+    }
+    return function;
+}
+
+// Copies the nodes of a function into a new one, map[old] is the value that
+// replaces old. Operands are defined before their uses, so a pass in order has
+// mapped them all by the time it reaches a node.
+struct Rewriter {
+    Function const& in;
+    Function out;
+    std::vector<Index> map;
+    std::vector<bool> fallible; // out value v, or one it is computed from, can raise a runtime error
+
+    explicit Rewriter(Function const& function)
+        : in(function)
+        , map(function.nodes.size(), NONE)
+    {
+    }
+
+    // the old node with its operands renamed
+    Node renamed(Index old) const
+    {
+        Node node = in.nodes[old];
+        if (node.a != NONE) { node.a = map[node.a]; }
+        if (node.b != NONE) { node.b = map[node.b]; }
+        return node;
+    }
+
+    Index add(Node const& node)
+    {
+        fallible.push_back(can_fail(node) || (node.a != NONE && fallible[node.a]) || (node.b != NONE && fallible[node.b]));
+        out.nodes.push_back(node);
+        return (Index)out.nodes.size() - 1;
+    }
+
+    Index constant(Value value, Index line)
+    {
+        Node node;
+        node.constant = value;
+        node.line = line;
+        node.type = Types::type_of(value);
+        return add(node);
+    }
+
+    Node const& value(Index v) const
+    {
+        return out.nodes[v];
+    }
+
+    bool number(Index v) const
+    {
+        return value(v).type == StaticType::Number;
+    }
+
+    // the constant k, -0 and 0 are told apart
+    bool is(Index v, Number k) const
+    {
+        Node const& node = value(v);
+        return node.op == Op::Constant && IS_NUMBER(node.constant) && AS_NUMBER(node.constant) == k
+            && std::signbit(AS_NUMBER(node.constant)) == std::signbit(k);
+    }
+
+    // -x of a number x, the negation can't fail then
+    bool negated_number(Index v) const
+    {
+        return value(v).op == Op::Negate && number(value(v).a);
+    }
+
+    // checked arithmetic on a value that may not be a number
+    bool can_fail(Node const& node) const
+    {
+        return is_arithmetic(node.op) && node.checked && (!number(node.a) || (node.b != NONE && !number(node.b)));
+    }
+};
+
+// arithmetic on number constants is computed at compile time
+static Function propagate_constants(Function const& function)
+{
+    Rewriter r(function);
+    for (Index i = 0; i < (Index)function.nodes.size(); ++i) {
+        Node node = r.renamed(i);
+        Value folded;
+        if (node.op == Op::Negate && r.value(node.a).op == Op::Constant && r.number(node.a)) {
+            r.map[i] = r.constant(-AS_NUMBER(r.value(node.a).constant), node.line);
+        }
+        else if (is_arithmetic(node.op) && node.op != Op::Negate && r.value(node.a).op == Op::Constant
+                 && r.value(node.b).op == Op::Constant
+                 && Optimizer::fold(opcode(node), r.value(node.a).constant, r.value(node.b).constant, folded)) {
+            r.map[i] = r.constant(folded, node.line);
+        }
+        else {
+            r.map[i] = r.add(node);
+        }
+    }
+    return r.out;
+}
+
+// Identities that hold for every number, NaN and -0 included. Returns the value
+// the node computes when that is already defined, otherwise it may rewrite the
+// node into a simpler one. Operands only swap places when neither can fail.
+static Index simplified(Rewriter const& r, Node& node)
+{
+    if (!is_arithmetic(node.op) || !r.number(node.a) || (node.b != NONE && !r.number(node.b))) {
+        return NONE; // the operand checks stay
+    }
+
+    switch (node.op) {
+    case Op::Negate:
+        if (r.negated_number(node.a)) { return r.value(node.a).a; } // -(-x)
+        break;
+
+    case Op::Add:
+        if (r.is(node.b, -0.0)) { return node.a; }
+        if (r.is(node.a, -0.0)) { return node.b; }
+        if (r.negated_number(node.b)) { // x + -y == x - y
+            node.op = Op::Subtract;
+            node.b = r.value(node.b).a;
+        }
+        else if (r.negated_number(node.a) && !r.fallible[node.a] && !r.fallible[node.b]) { // -x + y == y - x, y runs first
+            node.op = Op::Subtract;
+            node.a = std::exchange(node.b, r.value(node.a).a);
+        }
+        break;
+
+    case Op::Subtract:
+        if (r.is(node.b, 0.0)) { return node.a; }
+        if (r.negated_number(node.b)) { // x - -y == x + y
+            node.op = Op::Add;
+            node.b = r.value(node.b).a;
+        }
+        break;
+
+    case Op::Multiply:
+    case Op::Divide:
+        if (r.is(node.b, 1.0)) { return node.a; }
+        if (node.op == Op::Multiply && r.is(node.a, 1.0)) { return node.b; }
+        if (r.negated_number(node.a) && r.negated_number(node.b)) { // -x * -y == x * y, -x / -y == x / y
+            node.a = r.value(node.a).a;
+            node.b = r.value(node.b).a;
+        }
+        break;
+
+    default:
+        break;
+    }
+    return NONE;
+}
+
+static Function simplify(Function const& function)
+{
+    Rewriter r(function);
+    for (Index i = 0; i < (Index)function.nodes.size(); ++i) {
+        Node node = r.renamed(i);
+        Index same = simplified(r, node);
+        r.map[i] = (same != NONE) ? same : r.add(node);
+    }
+    return r.out;
+}
+
+// x / 2^k becomes x * 2^-k: the reciprocal is exact, so both round the same
+// real number, and a multiplication is a lot cheaper than a division. The
+// operand check stays as it is.
+static Function reduce_strength(Function const& function)
+{
+    Rewriter r(function);
+    for (Index i = 0; i < (Index)function.nodes.size(); ++i) {
+        Node node = r.renamed(i);
+        if (node.op == Op::Divide && r.value(node.b).op == Op::Constant && IS_NUMBER(r.value(node.b).constant)) {
+            Number divisor = AS_NUMBER(r.value(node.b).constant);
+            int exponent;
+            if (std::isnormal(divisor) && std::isnormal(1 / divisor) && std::fabs(std::frexp(divisor, &exponent)) == 0.5) {
+                node.op = Op::Multiply;
+                node.b = r.constant(1 / divisor, node.line);
+            }
+        }
+        r.map[i] = r.add(node);
+    }
+    return r.out;
+}
+
+// Value numbering: every constant and operation is computed once. That holds
+// for operations that can fail as well: a copy runs after the first one, so it
+// is only reached when the first one succeeded with the same operands.
+static Function eliminate_common_subexpressions(Function const& function)
+{
+    Rewriter r(function);
+    std::unordered_map<Value, Index, ValueHash, ValueIdentical> constants;
+    std::map<std::tuple<Op, Index, Index>, Index> operations;
+
+    for (Index i = 0; i < (Index)function.nodes.size(); ++i) {
+        Node node = r.renamed(i);
+        if (node.op == Op::Constant) {
+            auto found = constants.find(node.constant);
+            r.map[i] = (found != constants.end()) ? found->second : (constants[node.constant] = r.add(node));
+        }
+        else if (is_arithmetic(node.op)) {
+            auto key = std::make_tuple(node.op, node.a, node.b);
+            auto found = operations.find(key);
+            r.map[i] = (found != operations.end()) ? found->second : (operations[key] = r.add(node));
+        }
+        else {
+            r.map[i] = r.add(node);
+        }
+    }
+    return r.out;
+}
+
+// keeps what print and return need
+static Function eliminate_dead_code(Function const& function)
+{
+    const Index count = (Index)function.nodes.size();
+    std::vector<bool> live(count, false);
+    for (Index i = count - 1; i >= 0; --i) {
+        Node const& node = function.nodes[i];
+        if (node.op == Op::Print || node.op == Op::Return) { live[i] = true; }
+        if (!live[i]) { continue; }
+        if (node.a != NONE) { live[node.a] = true; }
+        if (node.b != NONE) { live[node.b] = true; }
+    }
+
+    Rewriter r(function);
+    for (Index i = 0; i < count; ++i) {
+        if (live[i]) { r.map[i] = r.add(r.renamed(i)); }
+    }
+    return r.out;
+}
+
+static void optimize(Function& function)
+{
+    function = propagate_constants(function);
+    function = simplify(function);
+    function = reduce_strength(function);
+    function = eliminate_common_subexpressions(function);
+    function = eliminate_dead_code(function);
+}
+
+// the stack slots reserved at the bottom of the stack for values used more than once
+struct Slots {
+    std::vector<Index> of;    // slot of each value, NONE when it is computed at its user
+    std::vector<bool> stored; // the value of the slot has been computed
+    Index count = 0;
+};
+
+// constants are cheaper to push again, past the last slot a value is computed again
+static Slots allocate_slots(Function const& function)
+{
+    const Index count = (Index)function.nodes.size();
+    std::vector<int> uses(count, 0);
+    for (auto const& node : function.nodes) {
+        if (node.a != NONE) { ++uses[node.a]; }
+        if (node.b != NONE) { ++uses[node.b]; }
+    }
+
+    Slots slots;
+    slots.of.assign(count, NONE);
+    for (Index v = 0; v < count && slots.count < 256; ++v) {
+        if (uses[v] > 1 && function.nodes[v].op != Op::Constant) { slots.of[v] = slots.count++; }
+    }
+    slots.stored.assign(slots.count, false);
+    return slots;
+}
+
+// the instructions computing v, or loading it when its slot is already stored
+static void lower_value(Function const& function, Slots& slots, Index v, Index line, Optimizer::Instructions& out)
+{
+    Node const& node = function.nodes[v];
+    if (node.op == Op::Constant) {
+        out.push_back({ OP_Constant, node.constant, line }); // errors of a fused op report the line of its user
+        return;
+    }
+    const Index slot = slots.of[v];
+    if (slot != NONE && slots.stored[slot]) {
+        out.push_back({ OP_Get_Slot, Value{}, line, (Byte)slot });
+        return;
+    }
+
+    lower_value(function, slots, node.a, node.line, out);
+    if (node.b != NONE) { lower_value(function, slots, node.b, node.line, out); }
+    out.push_back({ opcode(node), Value{}, node.line });
+    if (slot != NONE) {
+        out.push_back({ OP_Set_Slot, Value{}, node.line, (Byte)slot });
+        slots.stored[slot] = true;
+    }
+}
+
+// back to stack code, in the order of the prints and the return
+static void lower(Function const& function, Chunk& chunk, bool fuse)
+{
+    Slots slots = allocate_slots(function);
+    Optimizer::Instructions instructions;
+    for (Index slot = 0; slot < slots.count; ++slot) {
+        instructions.push_back({ OP_Constant, 0.0, function.nodes.front().line }); // reserves the slot
+    }
+    for (auto const& node : function.nodes) {
+        if (node.op == Op::Print || node.op == Op::Return) {
+            lower_value(function, slots, node.a, node.line, instructions);
+            instructions.push_back({ opcode(node), Value{}, node.line });
+        }
+    }
+    Optimizer::encode(instructions, chunk, fuse);
+}
+
+// one node per line, "v2 = add v0, v1"
+static std::string text(Function const& function)
+{
+    std::string out;
+    char buffer[64];
+    for (Index i = 0; i < (Index)function.nodes.size(); ++i) {
+        Node const& node = function.nodes[i];
+        std::snprintf(buffer, sizeof(buffer), "%4d | ", node.line);
+        out += buffer;
+        if (node.op != Op::Print && node.op != Op::Return) {
+            out += "v" + std::to_string(i) + " = ";
+        }
+        out += op_name(node.op);
+
+        if (node.op == Op::Constant) {
+            if (IS_NUMBER(node.constant))    { std::snprintf(buffer, sizeof(buffer), " %.17g", AS_NUMBER(node.constant)); }
+            else if (IS_BOOL(node.constant)) { std::snprintf(buffer, sizeof(buffer), AS_BOOL(node.constant) ? " true" : " false"); }
+            else                             { std::snprintf(buffer, sizeof(buffer), " nil"); }
+            out += buffer;
+        }
+        if (node.a != NONE) { out += " v" + std::to_string(node.a); }
+        if (node.b != NONE) { out += ", v" + std::to_string(node.b); }
+        if (is_arithmetic(node.op) && node.checked) { out += " (checked)"; }
+        out += "\n";
+    }
+    return out;
+}
+
+// the IR counterpart of Debug::show
+static inline void show(Function const& function, const char* name)
+{
+    std::printf("%s \n", name);
+    std::printf("=================================\n");
+    std::printf("Line| Node\n");
+    std::printf("=================================\n");
+    std::printf("%s", text(function).c_str());
+}
+
+}
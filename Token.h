@@ -1,9 +1,13 @@
 #pragma once
 
+#include <cstdint>
+
+// 12 bytes: a token only refers to its lexeme by offset into the source, the line
+// is looked up when somebody needs it (see LineIndex.h and Scanner::line_of)
 struct Token {
     // Embedding the type enum in the Token struct makes for more readable code.
     // Using an enum class would create pretty verbose expressions...
-    enum Type {
+    enum Type : uint32_t {
         // Single-character tokens.
         LeftParen, RightParen,
         LeftBrace, RightBrace,
@@ -29,8 +33,10 @@ struct Token {
         Eof
     };
 
-    Type type;
-    const char* start;
-    int length;
-    int line;
-};
\ No newline at end of file
+    uint32_t offset; // of the first character in the source
+    uint32_t length;
+    Type type : 8;
+    uint32_t literal : 24; // Number: index of the value in Scanner::numbers, Error: Scanner::errors
+};
+
+static_assert(sizeof(Token) == 12, "a token should stay three words small");
\ No newline at end of file
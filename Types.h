@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Common.h"
+#include "OpCodes.h"
+#include "Value.h"
+
+// Static types of the values an expression can produce, a flat lattice: the
+// concrete types at the bottom, Unknown above all of them. The compiler tracks
+// the type of every expression it parses and emits the unchecked arithmetic when
+// the operands are known to be numbers. The verifier runs the same rules over
+// the value stack of a chunk, so unchecked code from a file is proven again.
+enum class StaticType : Byte {
+    Unknown,
+    Nil,
+    Bool,
+    Number,
+};
+
+namespace Types {
+
+static StaticType type_of(Value const& value)
+{
+    if (IS_NUMBER(value)) { return StaticType::Number; }
+    if (IS_BOOL(value))   { return StaticType::Bool; }
+    return StaticType::Nil;
+}
+
+// the arithmetic op to emit for operands of these types (b is ignored for unary ops)
+static OpCode arithmetic_op(OpCode op, StaticType a, StaticType b = StaticType::Number)
+{
+    if (a == StaticType::Number && b == StaticType::Number && unchecked_op(op) != 0) {
+        return (OpCode)unchecked_op(op);
+    }
+    return op;
+}
+
+// arithmetic either leaves a number or stops with a runtime error
+static StaticType result_type(OpCode op)
+{
+    switch (checked_op(generic_op(op))) {
+    case OP_Add:
+    case OP_Subtract:
+    case OP_Multiply:
+    case OP_Divide:
+    case OP_Negate:
+    case OP_Add_Const:
+    case OP_Subtract_Const:
+    case OP_Multiply_Const:
+    case OP_Divide_Const:
+    case OP_Negate_Const:
+        return StaticType::Number;
+    default:
+        return StaticType::Unknown;
+    }
+}
+
+}
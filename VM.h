@@ -4,10 +4,17 @@
 
 #include "Common.h"
 #include "Chunk.h"
-#include "Scanner.h"
+#include "CompileCache.h"
+#include "Compiler.h"
+#include "Debug.h"
+#include "Jit.h"
 #include "OpCodes.h"
-#include "Token.h"
+#include "RegisterCode.h"
+#if defined(PROFILE_OPCODES)
+#include "Profiler.h"
+#endif
 #include "Value.h"
+#include "Verifier.h"
 
 enum class InterpretResult {
     Ok,
@@ -15,460 +22,736 @@ enum class InterpretResult {
     RuntimeError
 };
 
-struct Parser {
-    Token current;
-    Token previous;
-    bool error_raised = false;
-    bool panic_raised = false; // used instead of exceptions to unwind the whole stack
-
-    Parser() = default;
-};
-
-enum class Precedence {
-    None,
-    Assignment,  // =
-    Or,          // or
-    And,         // and
-    Equality,    // == !=
-    Comparison,  // < > <= >=
-    Term,        // + -
-    Factor,      // * /
-    Unary,       // ! - +
-    Call,        // . () []
-    Primary
-};
-
-
-
-// virtual machine
+// virtual machine, only executes compiled chunks and never changes them
 struct VM {
 
-    using Prec = Precedence; // just for a little less typing
-    typedef void (VM::*ParseFn)(); /// change to either 'using' or std::function ...
-
-    struct ParseRule {
-        ParseFn prefix;
-        ParseFn infix;
-        Precedence precedence;
-    };
-    using ParseRules = std::vector<ParseRule>;
-
-    ParseRules rules = {
-        { &VM::grouping,    nullptr,         Prec::Call },       // TOKEN_LEFT_PAREN
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_RIGHT_PAREN
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_LEFT_BRACE
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_RIGHT_BRACE
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_COMMA
-        { nullptr,          nullptr,         Prec::Call },       // TOKEN_DOT
-        { &VM::unary,       &VM::binary,     Prec::Term },       // TOKEN_MINUS
-        { nullptr,          &VM::binary,     Prec::Term },       // TOKEN_PLUS
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_SEMICOLON
-        { nullptr,          &VM::binary,     Prec::Factor },     // TOKEN_SLASH
-        { nullptr,          &VM::binary,     Prec::Factor },     // TOKEN_STAR
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_BANG
-        { nullptr,          nullptr,         Prec::Equality },   // TOKEN_BANG_EQUAL
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_EQUAL
-        { nullptr,          nullptr,         Prec::Equality },   // TOKEN_EQUAL_EQUAL
-        { nullptr,          nullptr,         Prec::Comparison }, // TOKEN_GREATER
-        { nullptr,          nullptr,         Prec::Comparison }, // TOKEN_GREATER_EQUAL
-        { nullptr,          nullptr,         Prec::Comparison }, // TOKEN_LESS
-        { nullptr,          nullptr,         Prec::Comparison }, // TOKEN_LESS_EQUAL
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_IDENTIFIER
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_STRING
-        { &VM::number,      nullptr,         Prec::None },       // TOKEN_NUMBER
-        { nullptr,          nullptr,         Prec::And },        // TOKEN_AND
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_CLASS
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_ELSE
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_FALSE
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_FUN
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_FOR
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_IF
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_NIL
-        { nullptr,          nullptr,         Prec::Or },         // TOKEN_OR
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_PRINT
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_RETURN
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_SUPER
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_THIS
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_TRUE
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_VAR
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_WHILE
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_ERROR
-        { nullptr,          nullptr,         Prec::None },       // TOKEN_EOF
-    };
-
-
-    Chunk chunk;
-    Chunk* compiling_chunk = nullptr;
-    std::size_t ip = 0; // instruction pointer
+    ChunkRef chunk; // keeps the running chunk alive, null while running a borrowed view
+    ChunkView program; // what run() executes, chunk or e.g. a mapped .loxc, in place until quickened
+    Bytes quick_code; // the VM's own copy of the loaded code, made by the first rewrite, the only bytes quickening writes
+    const Byte* quick_origin = nullptr; // the code quick_code was copied from
+    bool code_copied = false; // program.code points into quick_code
+    const Byte* ip = nullptr; // instruction pointer
     ValueStack stack;
-    std::unique_ptr<Scanner> scanner;
-
-    Parser parser;
+    Value* stack_top = nullptr; // one past the top most value
+    Value result; // value of the last OP_Return
+    std::size_t quickened = 0; // arithmetic sites this VM rewrote to their number-only form, each once
+    std::vector<bool> quick_sites; // offsets in quick_code counted in quickened
+    std::vector<StaticType> verify_types; // scratch space of Verifier::verify
+#if defined(PROFILE_OPCODES)
+    Profiler::Profile profile;
+#endif
+    Compiler compiler; // only used by interpret(source)
+    CompileCache cache; // sources interpret(source) has seen before
+    bool register_tier = false; // interpret(source) compiles for run_registers() instead
+    Jit::Cache jit; // hot chunks run as machine code, see Jit.h
 
     VM() = default;
 
-    Byte read_byte()
+    // no bounds checks: load() only accepts verified chunks and sizes the stack for them
+    void push(Value value)
     {
-        return chunk.code[ip++];
+        *stack_top++ = value;
     }
 
-    Value read_const()
+    Value pop()
     {
-        return chunk.constants[read_byte()];
+        return *--stack_top;
     }
 
-    void push(Value value)
+    Value peek(int distance) const
     {
-        stack.push_back(value);
+        return stack_top[-1 - distance];
     }
 
-    Value pop()
+    Size stack_size() const
     {
-        Value top = stack.back();
-        stack.pop_back();
-        return top;
+        return (Size)(stack_top - stack.data());
     }
 
-    InterpretResult interpret(Chunk c)
+    void reset_stack()
     {
-        chunk = c;
-        ip = 0;
-        return run();
+        stack_top = stack.data();
     }
 
-    InterpretResult interpret(std::string const& src)
+    // verify the code unless that happened before and get ready to run it, the
+    // constants and lines have to outlive the run. The code runs where it is, chunks
+    // may be shared, so the first rewrite moves it into a copy (see writable), which
+    // reloading the same code (again_same: still held by chunk) keeps using.
+    bool load(ChunkView view, bool again_same = false)
     {
-        Chunk new_chunk = {};
-        if (!compile(src, new_chunk)) {
+        if (!view.verified && !Verifier::verify(view, verify_types)) {
+            return false;
+        }
+
+        program = view;
+        code_copied = again_same && view.code == quick_origin && (Size)quick_code.size() == view.code_size;
+        if (code_copied) {
+            program.code = quick_code.data();
+        }
+        if ((Size)stack.size() < program.max_stack) {
+            stack.resize(program.max_stack);
+        }
+        reset_stack();
+        ip = program.code;
+        return true;
+    }
+
+    InterpretResult interpret(ChunkRef c)
+    {
+        if (c == nullptr) {
+            return InterpretResult::CompileError;
+        }
+        const bool again_same = (c == chunk);
+        chunk = std::move(c);
+        if (!load(ChunkView(*chunk), again_same)) {
             return InterpretResult::CompileError;
         }
+        if (Jit::Code* native = jit.hot(chunk)) {
+            return finish(run_native(*native));
+        }
+        InterpretResult ir = run();
+#if defined(DEBUG_PRINT_CODE)
+        show_quickened();
+#endif
+        return finish(ir);
+    }
+
+    InterpretResult interpret(ChunkView view)
+    {
+        if (!load(view)) {
+            return InterpretResult::CompileError;
+        }
+        InterpretResult ir = run();
+#if defined(DEBUG_PRINT_CODE)
+        show_quickened();
+#endif
+        return finish(ir);
+    }
+
+    InterpretResult interpret(std::string const& src)
+    {
+        return interpret(src.data(), (Size)src.size());
+    }
 
-        chunk = new_chunk;
-        ip = 0;
+    // convenience for the REPL and hosts: compile with the own compiler (or take the
+    // chunk from the cache when the source was seen before), then run
+    InterpretResult interpret(const char* src, Size length)
+    {
+        if (register_tier) {
+            RegisterChunk code;
+            if (!compiler.compile(src, length, code)) {
+                return InterpretResult::CompileError;
+            }
+            return interpret(code);
+        }
+        return interpret(cache.compile(compiler, src, length));
+    }
 
-        auto result = run();
-        assert(result == InterpretResult::Ok);
+    InterpretResult interpret(RegisterChunk const& code)
+    {
+        return finish(run_registers(code));
+    }
 
-        return result;
+    InterpretResult finish(InterpretResult ir) const
+    {
+        if (ir == InterpretResult::Ok) {
+            std::printf("return ");
+            print_value(result);
+            std::printf("\n");
+        }
+        return ir;
     }
 
     void print_stack() const
     {
-        for (std::size_t n = 0; n < stack.size(); ++n) {
-            auto slot = stack[n];
-            std::printf("[%g]", slot);
+        for (const Value* slot = stack.data(); slot < stack_top; ++slot) {
+            std::printf("[");
+            print_value(*slot);
+            std::printf("]");
         }
         std::printf("\n");
     }
 
+    // at points into program.code, which moves into quick_code the first time, the
+    // same byte in the VM's own copy
+    Byte* writable(const Byte* at)
+    {
+        std::size_t offset = at - program.code;
+        if (!code_copied) {
+            quick_code.assign(program.code, program.code + program.code_size);
+            quick_sites.assign(quick_code.size(), false);
+            quick_origin = program.code;
+            program.code = quick_code.data();
+            code_copied = true;
+        }
+        return quick_code.data() + offset;
+    }
+
+    // rewrites the instruction before ip into an opcode with the same stack effect,
+    // returns ip in the code run() has to continue with
+    const Byte* rewrite(const Byte* ip, OpCode op)
+    {
+        Byte* at = writable(ip - 1);
+        *at = op;
+        return at + 1;
+    }
+
+    // a site that turned back and gets quickened again isn't counted twice
+    const Byte* quicken(const Byte* ip, OpCode op)
+    {
+        ip = rewrite(ip, op);
+        std::size_t site = ip - 1 - program.code;
+        if (!quick_sites[site]) {
+            quick_sites[site] = true;
+            quickened++;
+        }
+        return ip;
+    }
+
+#if defined(DEBUG_PRINT_CODE)
+    // the code as this VM rewrote it, if it did
+    void show_quickened() const
+    {
+        if (!code_copied) { return; }
+        Debug::show(program, "code after quickening");
+        std::printf("quickened sites: %zu\n", quickened);
+    }
+#endif
+
+    // The dispatch loop is written once with the vm_* macros below and expands to
+    // either a threaded loop (every handler ends in its own indirect jump through
+    // a label table, see COMPUTED_GOTO in Common.h) or the portable switch.
     InterpretResult run()
     {
         // just to make the code a little more readable:
         using IR = InterpretResult;
 
+        // work on a local copy, so the compiler can keep it in a register
+        const Byte* ip = this->ip;
+
+#define READ_BYTE()  (*ip++)
+#define READ_CONST() (program.constants[READ_BYTE()])
+#define READ_CONST_LONG() (ip += 3, program.constants[ip[-3] | (ip[-2] << 8) | (ip[-1] << 16)])
+
+#define RUNTIME_ERROR(...)            \
+        do {                          \
+            this->ip = ip;            \
+            PROFILE_STOP();           \
+            runtime_error(__VA_ARGS__); \
+            return IR::RuntimeError;  \
+        } while (false)
+
+#define NUMBERS_ON_TOP() (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1)))
+
+#define NUMBER_OP(op)                                       \
+        do {                                                \
+            Number b = AS_NUMBER(pop());                    \
+            Number a = AS_NUMBER(pop());                    \
+            push(a op b);                                   \
+        } while (false)
+
+// the generic form checks the operands and quickens itself once it saw two numbers
+#define BINARY_OP(op, quick)                                \
+        do {                                                \
+            if (!NUMBERS_ON_TOP()) {                        \
+                RUNTIME_ERROR("Operands must be numbers."); \
+            }                                               \
+            ip = quicken(ip, quick);                        \
+            NUMBER_OP(op);                                  \
+        } while (false)
+
+// superinstructions: the constant operand is the right hand side, the result
+// replaces the left hand side right on the stack
+#define CONST_OP(op)                                        \
+        do {                                                \
+            if (!IS_NUMBER(peek(0))) {                      \
+                RUNTIME_ERROR("Operands must be numbers."); \
+            }                                               \
+            Number b = AS_NUMBER(READ_CONST());             \
+            stack_top[-1] = AS_NUMBER(peek(0)) op b;        \
+        } while (false)
+
+// the operands were proven to be numbers (see Types.h), telling the C++ compiler
+// as well lets it drop the type dispatch of copying a std::variant
+#define UNCHECKED_OP(op)                                    \
+        do {                                                \
+            ASSUME(NUMBERS_ON_TOP());                       \
+            NUMBER_OP(op);                                  \
+        } while (false)
+
+#define UNCHECKED_CONST_OP(op)                              \
+        do {                                                \
+            ASSUME(IS_NUMBER(peek(0)));                     \
+            Number b = AS_NUMBER(READ_CONST());             \
+            stack_top[-1] = AS_NUMBER(peek(0)) op b;        \
+        } while (false)
+
+// the quickened form only guards, on other operands it turns back into the generic
+// opcode and runs that one, still as the same instruction for the profiler
+#define GUARD_NUMBERS(generic)                              \
+        if (!NUMBERS_ON_TOP()) {                            \
+            ip = rewrite(ip, generic);                      \
+            PROFILE_RELABEL(generic);                       \
+            vm_redispatch(generic);                         \
+        }
+
+#if defined(DEBUG_TRACE_EXECUTION)
+#define TRACE() print_stack()
+#else
+#define TRACE() ((void)0)
+#endif
+
+#if defined(PROFILE_OPCODES)
+#define PROFILE_STEP() profile.step(program, ip)
+#define PROFILE_RELABEL(op) profile.relabel(op)
+#define PROFILE_STOP() profile.stop()
+#else
+#define PROFILE_STEP() ((void)0)
+#define PROFILE_RELABEL(op) ((void)0)
+#define PROFILE_STOP() ((void)0)
+#endif
+
+#if defined(COMPUTED_GOTO)
+        // same order as the OpCode enum, slot 0 is not a valid instruction
+        static const void* const dispatch_table[] = {
+            &&vm_unknown,
+            &&vm_OP_Constant,
+            &&vm_OP_Constant_Long,
+            &&vm_OP_Add,
+            &&vm_OP_Subtract,
+            &&vm_OP_Multiply,
+            &&vm_OP_Divide,
+            &&vm_OP_Negate,
+            &&vm_OP_Print,
+            &&vm_OP_Return,
+            &&vm_OP_Add_NumNum,
+            &&vm_OP_Subtract_NumNum,
+            &&vm_OP_Multiply_NumNum,
+            &&vm_OP_Divide_NumNum,
+            &&vm_OP_Add_Const,
+            &&vm_OP_Subtract_Const,
+            &&vm_OP_Multiply_Const,
+            &&vm_OP_Divide_Const,
+            &&vm_OP_Negate_Const,
+            &&vm_OP_Add_Unchecked,
+            &&vm_OP_Subtract_Unchecked,
+            &&vm_OP_Multiply_Unchecked,
+            &&vm_OP_Divide_Unchecked,
+            &&vm_OP_Negate_Unchecked,
+            &&vm_OP_Add_Const_Unchecked,
+            &&vm_OP_Subtract_Const_Unchecked,
+            &&vm_OP_Multiply_Const_Unchecked,
+            &&vm_OP_Divide_Const_Unchecked,
+            &&vm_OP_Get_Slot,
+            &&vm_OP_Set_Slot,
+        };
+        static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) == OP_Count, "dispatch table out of sync with OpCode");
+
+#define vm_next()    do { TRACE(); PROFILE_STEP(); goto *dispatch_table[READ_BYTE()]; } while (false)
+#define vm_redispatch(op) goto *dispatch_table[op] // the opcode was already read
+#define vm_case(op)  vm_##op
+#define vm_default() vm_unknown
+
+        vm_next();
+        {
+#else
+#define vm_next()    break
+#define vm_redispatch(op) do { instruction = (op); goto dispatch; } while (false)
+#define vm_case(op)  case op
+#define vm_default() default
+
+        Byte instruction;
         forever {
+            TRACE();
+            PROFILE_STEP();
+            instruction = READ_BYTE();
+        dispatch:
+            switch (instruction) {
+#endif
 
-            print_stack();
+            vm_case(OP_Constant): {
+                push(READ_CONST());
+                vm_next();
+            }
 
-            auto instruction = (OpCode)read_byte();
-            switch (instruction) {
+            vm_case(OP_Constant_Long): {
+                push(READ_CONST_LONG());
+                vm_next();
+            }
 
-            case OP_Constant: {
-                Value constant = read_const();
-                push(constant);
-                break;
+            vm_case(OP_Add): {
+                BINARY_OP(+, OP_Add_NumNum);
+                vm_next();
             }
 
-            case OP_Add: {
+            vm_case(OP_Subtract): {
+                BINARY_OP(-, OP_Subtract_NumNum);
+                vm_next();
+            }
 
-                if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) {
-                    runtime_error("Operands must be numbers.");
-                    return IR::RuntimeError;
-                }
+            vm_case(OP_Multiply): {
+                BINARY_OP(*, OP_Multiply_NumNum);
+                vm_next();
+            }
 
-                Number a = AS_NUMBER(pop());
-                Number b = AS_NUMBER(pop());
-                push(a + b);
-                break;
+            vm_case(OP_Divide): {
+                BINARY_OP(/, OP_Divide_NumNum);
+                vm_next();
             }
 
-            case OP_Subtract: {
+            vm_case(OP_Negate): {
 
-                if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) {
-                    runtime_error("Operands must be numbers.");
-                    return IR::RuntimeError;
+                if (!IS_NUMBER(peek(0))) {
+                    RUNTIME_ERROR("Operand must be a number!");
                 }
 
-                Number a = AS_NUMBER(pop());
-                Number b = AS_NUMBER(pop());
-                push(a - b);
-                break;
+                push(-AS_NUMBER(pop()));
+                vm_next();
             }
 
-            case OP_Multiply: {
+            vm_case(OP_Print): {
+                print_value(pop());
+                std::printf("\n");
+                vm_next();
+            }
 
-                if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) {
-                    runtime_error("Operands must be numbers.");
-                    return IR::RuntimeError;
-                }
+            vm_case(OP_Return): {
+                result = pop();
+                this->ip = ip;
+                PROFILE_STOP();
+                return IR::Ok;
+            }
 
-                Number a = AS_NUMBER(pop());
-                Number b = AS_NUMBER(pop());
-                push(a * b);
-                break;
+            vm_case(OP_Add_NumNum): {
+                GUARD_NUMBERS(OP_Add);
+                NUMBER_OP(+);
+                vm_next();
             }
 
-            case OP_Divide: {
+            vm_case(OP_Subtract_NumNum): {
+                GUARD_NUMBERS(OP_Subtract);
+                NUMBER_OP(-);
+                vm_next();
+            }
 
-                if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) {
-                    runtime_error("Operands must be numbers.");
-                    return IR::RuntimeError;
-                }
+            vm_case(OP_Multiply_NumNum): {
+                GUARD_NUMBERS(OP_Multiply);
+                NUMBER_OP(*);
+                vm_next();
+            }
 
-                Number a = AS_NUMBER(pop());
-                Number b = AS_NUMBER(pop());
+            vm_case(OP_Divide_NumNum): {
+                GUARD_NUMBERS(OP_Divide);
+                NUMBER_OP(/);
+                vm_next();
+            }
 
-                push(a / b);
-                break;
+            vm_case(OP_Add_Const): {
+                CONST_OP(+);
+                vm_next();
             }
 
-            case OP_Negate: {
+            vm_case(OP_Subtract_Const): {
+                CONST_OP(-);
+                vm_next();
+            }
 
-                if (!IS_NUMBER(peek(0))) {
-                    runtime_error("Operand must be a number!");
-                    return IR::RuntimeError;
-                }
+            vm_case(OP_Multiply_Const): {
+                CONST_OP(*);
+                vm_next();
+            }
 
-                const auto value = pop();
-                const auto num_value = std::get<double>(value);
-                push(-num_value);
-                break;
+            vm_case(OP_Divide_Const): {
+                CONST_OP(/);
+                vm_next();
             }
 
-            case OP_Return: {
-                std::printf("return %g\n", pop());
-                return IR::Ok;
+            vm_case(OP_Negate_Const): {
+                push(-AS_NUMBER(READ_CONST())); // the verifier made sure it's a number
+                vm_next();
             }
 
-            default:
-                break;
+            // the verifier proved the operands of these are numbers
+            vm_case(OP_Add_Unchecked): {
+                UNCHECKED_OP(+);
+                vm_next();
             }
-        }
 
-        return InterpretResult::Ok;
-    }
+            vm_case(OP_Subtract_Unchecked): {
+                UNCHECKED_OP(-);
+                vm_next();
+            }
 
-    Value peek(int distance) const
-    {
-        return stack[distance];
-    }
+            vm_case(OP_Multiply_Unchecked): {
+                UNCHECKED_OP(*);
+                vm_next();
+            }
 
-    bool compile(std::string const& src, Chunk& chunk)
-    {
-        scanner = std::make_unique<Scanner>(src.c_str());
-        compiling_chunk = &chunk; // move in compiler constructor
+            vm_case(OP_Divide_Unchecked): {
+                UNCHECKED_OP(/);
+                vm_next();
+            }
+
+            vm_case(OP_Negate_Unchecked): {
+                ASSUME(IS_NUMBER(peek(0)));
+                stack_top[-1] = -AS_NUMBER(peek(0));
+                vm_next();
+            }
 
-        advance();
-        expression();
-        consume(Token::Eof, "Expected EoF token!");
-        end_compiler();
+            vm_case(OP_Add_Const_Unchecked): {
+                UNCHECKED_CONST_OP(+);
+                vm_next();
+            }
 
-        return !parser.error_raised;
-    }
+            vm_case(OP_Subtract_Const_Unchecked): {
+                UNCHECKED_CONST_OP(-);
+                vm_next();
+            }
 
-    // should be part of compiler object!
-    void advance()
-    {
-        parser.previous = parser.current;
+            vm_case(OP_Multiply_Const_Unchecked): {
+                UNCHECKED_CONST_OP(*);
+                vm_next();
+            }
 
-        forever {
-            parser.current = scanner->scan_token();
-            if (parser.current.type != Token::Error) { break; }
+            vm_case(OP_Divide_Const_Unchecked): {
+                UNCHECKED_CONST_OP(/);
+                vm_next();
+            }
+
+            // the verifier made sure the slot is below the top
+            vm_case(OP_Get_Slot): {
+                push(stack[READ_BYTE()]);
+                vm_next();
+            }
+
+            vm_case(OP_Set_Slot): {
+                stack[READ_BYTE()] = peek(0);
+                vm_next();
+            }
 
-            error_at_current(parser.current.start);
+            vm_default(): {
+                vm_next();
+            }
+
+#if !defined(COMPUTED_GOTO)
+            }
+#endif
         }
-    }
 
-    void error_at_current(const char* msg)
-    {
-        error_at(&parser.current, msg);
+#undef vm_default
+#undef vm_case
+#undef vm_redispatch
+#undef vm_next
+#undef PROFILE_STOP
+#undef PROFILE_RELABEL
+#undef PROFILE_STEP
+#undef TRACE
+#undef GUARD_NUMBERS
+#undef UNCHECKED_CONST_OP
+#undef UNCHECKED_OP
+#undef CONST_OP
+#undef BINARY_OP
+#undef NUMBER_OP
+#undef NUMBERS_ON_TOP
+#undef RUNTIME_ERROR
+#undef READ_CONST_LONG
+#undef READ_CONST
+#undef READ_BYTE
+
+        return InterpretResult::Ok;
     }
 
-    void error(const char* msg)
+    // runs the machine code the JIT made of the loaded chunk
+    InterpretResult run_native(Jit::Code& code)
     {
-        error_at(&parser.previous, msg);
+        Jit::Context context;
+        context.frame = code.frame.data();
+        if (code.entry(&context) != 0) {
+            ip = program.code + context.error_offset + 1; // runtime_error() reports the line of ip - 1
+            runtime_error("%s", context.error);
+            return InterpretResult::RuntimeError;
+        }
+        result = context.result;
+        return InterpretResult::Ok;
     }
 
-    void error_at(Token* token, const char* msg)
+    // Execution loop of the register tier (see RegisterCode.h), the value stack
+    // serves as the frame. The code comes straight from the Compiler, it has no
+    // file format and isn't verified, the emitter keeps every operand in range.
+    InterpretResult run_registers(RegisterChunk const& code)
     {
-        if (parser.panic_raised) { return; }
-        parser.panic_raised = true;
-
-        std::fprintf(stderr, "[line %d] Error", token->line);
+        using IR = InterpretResult;
 
-        if (token->type == Token::Eof) {
-            std::fprintf(stderr, " at end");
-        }
-        else if (token->type == Token::Error) {
-            // Nothing.
-        }
-        else {
-            std::fprintf(stderr, " at '%.*s'", token->length, token->start);
+        if ((Size)stack.size() < code.frame_size) {
+            stack.resize(code.frame_size);
         }
+        Value* R = stack.data();
+        const Value* K = code.constants.data();
+        const RegInstr* ip = code.code.data();
+        RegInstr i;
+
+#define RUNTIME_ERROR(msg)                                                  \
+        do {                                                                \
+            register_error(code, (Index)(ip - code.code.data() - 1), msg); \
+            return IR::RuntimeError;                                        \
+        } while (false)
+
+// x and y may be the target register, both are read before it's written
+#define REGISTER_OP(op, x, y)                               \
+        do {                                                \
+            if (!IS_NUMBER(x) || !IS_NUMBER(y)) {           \
+                RUNTIME_ERROR("Operands must be numbers."); \
+            }                                               \
+            Number value = AS_NUMBER(x) op AS_NUMBER(y);    \
+            R[i.a] = value;                                 \
+        } while (false)
+
+#if defined(COMPUTED_GOTO)
+        // same order as the RegOp enum, slot 0 is not a valid instruction
+        static const void* const dispatch_table[] = {
+            &&vm_unknown,
+            &&vm_R_LoadK,
+            &&vm_R_Add,
+            &&vm_R_Subtract,
+            &&vm_R_Multiply,
+            &&vm_R_Divide,
+            &&vm_R_Add_RK,
+            &&vm_R_Subtract_RK,
+            &&vm_R_Multiply_RK,
+            &&vm_R_Divide_RK,
+            &&vm_R_Subtract_KR,
+            &&vm_R_Divide_KR,
+            &&vm_R_Negate,
+            &&vm_R_Print,
+            &&vm_R_Return,
+        };
+        static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) == R_Count, "dispatch table out of sync with RegOp");
+
+#define vm_next()    do { i = *ip++; goto *dispatch_table[i.op]; } while (false)
+#define vm_case(op)  vm_##op
+#define vm_default() vm_unknown
+
+        vm_next();
+        {
+#else
+#define vm_next()    break
+#define vm_case(op)  case op
+#define vm_default() default
 
-        std::fprintf(stderr, ": %s\n", msg);
-        parser.error_raised = true;
-    }
+        forever {
+            i = *ip++;
+            switch (i.op) {
+#endif
 
-    void runtime_error(const char* fmt, ...)
-    {
-        va_list args; /// change for variadic template?
-        va_start(args, fmt);
-        vfprintf(stderr, fmt, args);
-        va_end(args);
-        fputs("\n", stderr);
+            vm_case(R_LoadK): {
+                R[i.a] = K[i.b | (i.c << 8)];
+                vm_next();
+            }
 
-        std::size_t instruction = ip - chunk.code.size();
-        fprintf(stderr, "[line %d] in script}n", chunk.lines[instruction]);
+            vm_case(R_Add): {
+                REGISTER_OP(+, R[i.b], R[i.c]);
+                vm_next();
+            }
 
-        /// reset_stack
-    }
+            vm_case(R_Subtract): {
+                REGISTER_OP(-, R[i.b], R[i.c]);
+                vm_next();
+            }
 
-    void consume(Token::Type type, const char* msg)
-    {
-        if (parser.current.type == type) {
-            advance();
-            return;
-        }
+            vm_case(R_Multiply): {
+                REGISTER_OP(*, R[i.b], R[i.c]);
+                vm_next();
+            }
 
-        error_at_current(msg);
-    }
+            vm_case(R_Divide): {
+                REGISTER_OP(/, R[i.b], R[i.c]);
+                vm_next();
+            }
 
-    void expression()
-    {
-        parse_precedence(Prec::Assignment);
-    }
+            vm_case(R_Add_RK): {
+                REGISTER_OP(+, R[i.b], K[i.c]);
+                vm_next();
+            }
 
-    void number()
-    {
-        double value = std::strtod(parser.previous.start, NULL);
-        emit_constant(value);
-    }
+            vm_case(R_Subtract_RK): {
+                REGISTER_OP(-, R[i.b], K[i.c]);
+                vm_next();
+            }
 
-    void emit_byte(Byte byte)
-    {
-        auto current = compiling_chunk;
-        current->write(byte, parser.previous.line);
-    }
+            vm_case(R_Multiply_RK): {
+                REGISTER_OP(*, R[i.b], K[i.c]);
+                vm_next();
+            }
 
-    void emit_constant(Value value)
-    {
-        emit_bytes(OP_Constant, make_constant(value));
-    }
+            vm_case(R_Divide_RK): {
+                REGISTER_OP(/, R[i.b], K[i.c]);
+                vm_next();
+            }
 
-    Byte make_constant(Value value)
-    {
-        auto c = compiling_chunk;
-        auto constant = c->add_const(value);
-        if (constant > UINT8_MAX) {
-            error("Too many constants in one chunk.");
-            return 0;
-        }
+            vm_case(R_Subtract_KR): {
+                REGISTER_OP(-, K[i.b], R[i.c]);
+                vm_next();
+            }
 
-        return (Byte) constant;
-    }
+            vm_case(R_Divide_KR): {
+                REGISTER_OP(/, K[i.b], R[i.c]);
+                vm_next();
+            }
 
-    void grouping()
-    {
-        expression();
-        consume(Token::RightParen, "Expected ')' after expression.");
-    }
+            vm_case(R_Negate): {
+                if (!IS_NUMBER(R[i.b])) {
+                    RUNTIME_ERROR("Operand must be a number!");
+                }
+                R[i.a] = -AS_NUMBER(R[i.b]);
+                vm_next();
+            }
 
-    void unary()
-    {
-        Token::Type operator_type = parser.previous.type;
-
-        // compile operand
-        expression();
-
-        // emit operator instruction
-        switch (operator_type) {
-        case Token::Minus:
-            emit_byte(OP_Negate);
-            break;
-        default:
-            assert(false);
-            break;
-        }
-    }
+            vm_case(R_Print): {
+                print_value(R[i.a]);
+                std::printf("\n");
+                vm_next();
+            }
 
-    void binary()
-    {
-        // remember operator
-        Token::Type operatorType = parser.previous.type;
-
-        // compile right operand.
-        ParseRule* rule = get_rule(operatorType);
-        auto next_prec_level = (int)rule->precedence + 1;
-        parse_precedence((Precedence)(next_prec_level));
-
-        // Emit the operator instruction.
-        switch (operatorType) {
-        case Token::Plus:
-            emit_byte(OP_Add);
-            break;
-        case Token::Minus:
-            emit_byte(OP_Subtract);
-            break;
-        case Token::Star:
-            emit_byte(OP_Multiply);
-            break;
-        case Token::Slash:
-            emit_byte(OP_Divide);
-            break;
-        default:
-            return; // Unreachable.
-        }
-    }
+            vm_case(R_Return): {
+                result = R[i.a];
+                return IR::Ok;
+            }
 
-    ParseRule* get_rule(Token::Type type)
-    {
-        return &rules[type];
-    }
+            vm_default(): {
+                vm_next();
+            }
 
-    void parse_precedence(Precedence prec)
-    {
-        advance();
-        auto prefixRule = get_rule(parser.previous.type);
-        auto prefix = prefixRule->prefix;
-        if (prefixRule == NULL) {
-            error("Expect expression.");
-            return;
+#if !defined(COMPUTED_GOTO)
+            }
+#endif
         }
 
-        (*this.*prefix)(); // pretty sure thats the most horrible expression that I have ever to write in c++...
+#undef vm_default
+#undef vm_case
+#undef vm_next
+#undef REGISTER_OP
+#undef RUNTIME_ERROR
 
-        while (prec <= get_rule(parser.current.type)->precedence) {
-            advance();
-            auto infixRule = get_rule(parser.previous.type);
-            auto infix = infixRule->infix;
-            (*this.*infix)();
-        }
+        return InterpretResult::Ok;
     }
 
-    void emit_bytes(Byte byte1, Byte byte2)
+    void register_error(RegisterChunk const& code, Index instruction, const char* msg)
     {
-        emit_byte(byte1);
-        emit_byte(byte2);
+        std::fprintf(stderr, "%s\n[line %d] in script\n", msg, code.line_at(instruction));
     }
 
-    void end_compiler()
+    void runtime_error(const char* fmt, ...)
     {
-        emit_return();
-    }
+        va_list args; /// change for variadic template?
+        va_start(args, fmt);
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+        fputs("\n", stderr);
 
-    void emit_return()
-    {
-        emit_byte(OP_Return);
+        std::size_t instruction = ip - program.code - 1;
+        fprintf(stderr, "[line %d] in script\n", program.line_at((Index)instruction));
+
+        reset_stack();
     }
+
 };
\ No newline at end of file
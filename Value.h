@@ -1,19 +1,89 @@
 #pragma once
 
+#include <cstdio>
+#include <cstring>
+#include <functional>
 #include <variant>
 #include <vector>
-#include <deque>
+
+#include "Common.h"
 
 // Value type: Nystrom uses a self constructed tagged union for the Lox Value,
-// but I rather learn about std::variant instead
+// but I rather learn about std::variant instead.
+// Building with NAN_BOXING (see Common.h) swaps the variant for a single 64-bit
+// word, both versions share the same constructors and accessor macros.
 
 struct Nil {};
 
 using Number = double;
-using Value  = std::variant<Nil, bool, Number>;
 
-using Values     = std::vector<Value>;
-using ValueStack = std::deque<Value>; // std::stack doesn't allow random access...
+#if defined(NAN_BOXING)
+
+// NaN boxing: every double that isn't a quiet NaN is stored as is, everything else
+// hides in the unused mantissa bits of a quiet NaN:
+//
+//   [sign][11 bits exponent][quiet][tag/payload .... 50 bits ....]
+//      0    11111111111       1     ... 01  -> nil
+//      0    11111111111       1     ... 10  -> false
+//      0    11111111111       1     ... 11  -> true
+//      1    11111111111       1     <pointer>  -> reserved for heap objects
+//
+// So every type check is a single mask-and-compare.
+
+#define SIGN_BIT  ((uint64_t)0x8000000000000000)
+#define QNAN      ((uint64_t)0x7ffc000000000000)
+
+#define TAG_NIL   1 // 01
+#define TAG_FALSE 2 // 10
+#define TAG_TRUE  3 // 11
+
+struct Value {
+    uint64_t bits;
+
+    Value() : bits(QNAN | TAG_NIL) {}
+    Value(Nil) : bits(QNAN | TAG_NIL) {}
+    Value(bool b) : bits(b ? (QNAN | TAG_TRUE) : (QNAN | TAG_FALSE)) {}
+    Value(Number n) { std::memcpy(&bits, &n, sizeof(Number)); }
+};
+
+static_assert(sizeof(Value) == sizeof(uint64_t), "a boxed value has to fit into one word");
+
+static inline Number value_to_num(Value v)
+{
+    Number n;
+    std::memcpy(&n, &v.bits, sizeof(Number));
+    return n;
+}
+
+// accessors for readability
+#define IS_NIL(v)    ((v).bits == (QNAN | TAG_NIL))
+#define IS_BOOL(v)   (((v).bits | 1) == (QNAN | TAG_TRUE))
+#define IS_NUMBER(v) (((v).bits & QNAN) != QNAN)
+
+#define AS_NIL(v)    (Nil{})
+#define AS_BOOL(v)   ((v).bits == (QNAN | TAG_TRUE))
+#define AS_NUMBER(v) (value_to_num(v))
+
+// bit-wise identity, unlike == this keeps 0.0 and -0.0 apart and matches equal NaNs
+static inline bool values_identical(Value a, Value b)
+{
+    return a.bits == b.bits;
+}
+
+static inline std::size_t value_hash(Value v)
+{
+    return std::hash<uint64_t>{}(v.bits);
+}
+
+#else
+
+using Value = std::variant<Nil, bool, Number>;
+
+// unchecked (doesn't throw like std::get), only use after IS_NUMBER
+static inline Number value_to_num(Value const& v)
+{
+    return *std::get_if<Number>(&v);
+}
 
 // accessors for readability
 #define IS_NIL(v)    (v.index() == 0)
@@ -22,4 +92,49 @@ using ValueStack = std::deque<Value>; // std::stack doesn't allow random access.
 
 #define AS_NIL(v)    (std::get<Nil>(v))
 #define AS_BOOL(v)   (std::get<bool>(v))
-#define AS_NUMBER(v) (std::get<Number>(v))
\ No newline at end of file
+#define AS_NUMBER(v) (value_to_num(v))
+
+static inline uint64_t value_bits(Value const& v)
+{
+    uint64_t bits = 0;
+    if (IS_BOOL(v))   { bits = AS_BOOL(v); }
+    if (IS_NUMBER(v)) { std::memcpy(&bits, std::get_if<Number>(&v), sizeof(Number)); }
+    return bits;
+}
+
+// bit-wise identity, unlike == this keeps 0.0 and -0.0 apart and matches equal NaNs
+static inline bool values_identical(Value const& a, Value const& b)
+{
+    return a.index() == b.index() && value_bits(a) == value_bits(b);
+}
+
+static inline std::size_t value_hash(Value const& v)
+{
+    return std::hash<uint64_t>{}(value_bits(v)) ^ v.index();
+}
+
+#endif
+
+// so a Value can be used as key of a std::unordered_map
+struct ValueHash {
+    std::size_t operator()(Value const& v) const { return value_hash(v); }
+};
+struct ValueIdentical {
+    bool operator()(Value const& a, Value const& b) const { return values_identical(a, b); }
+};
+
+using Values     = std::vector<Value>;
+using ValueStack = std::vector<Value>; // sized once per chunk, see Chunk::max_stack
+
+static void print_value(Value value)
+{
+    if (IS_NIL(value)) {
+        std::printf("nil");
+    }
+    else if (IS_BOOL(value)) {
+        std::printf(AS_BOOL(value) ? "true" : "false");
+    }
+    else {
+        std::printf("%g", AS_NUMBER(value));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include "Common.h"
+#include "Chunk.h"
+#include "OpCodes.h"
+#include "Types.h"
+
+// The verifier runs once per chunk: when the compiler hands it out, when a .loxc file
+// is loaded or, for chunks from anywhere else, when the VM loads it. A chunk that passes
+// never under- or overflows the value stack (VM::run relies on that and doesn't
+// check its stack accesses), only holds known opcodes with complete operands,
+// only references existing constants (numbers for the superinstructions), only
+// runs unchecked arithmetic on values proven to be numbers, only uses stack slots
+// below the top and ends with a return.
+namespace Verifier {
+
+static bool fail(Index offset, const char* msg)
+{
+    std::fprintf(stderr, "Invalid chunk at %04d: %s\n", offset, msg);
+    return false;
+}
+
+// types: scratch space for the types on the stack, see Types.h
+static bool verify(ChunkView const& chunk, std::vector<StaticType>& types)
+{
+    const Size size = chunk.code_size;
+    for (Size n = 0; n < chunk.line_count; ++n) {
+        Index run_start = chunk.lines[n].offset;
+        bool ordered = (n == 0) ? (run_start == 0) : (run_start > chunk.lines[n - 1].offset);
+        if (!ordered || run_start >= size) {
+            return fail(run_start, "line table doesn't match the byte code.");
+        }
+    }
+    if (size > 0 && chunk.line_count == 0) {
+        return fail(0, "missing line table.");
+    }
+
+    Size depth = 0;
+    Size max_depth = 0;
+    bool returned = false;
+    types.clear();
+    for (Index offset = 0; offset < size; /**/) {
+        Byte op = chunk.code[offset];
+        if (!is_opcode(op)) {
+            return fail(offset, "unknown opcode.");
+        }
+
+        OpInfo const& info = op_info(op);
+        if (offset + info.operands >= size) {
+            return fail(offset, "missing operand.");
+        }
+        if (has_constant_operand(op) && chunk.constant_index(offset) >= chunk.constant_count) {
+            return fail(offset, "constant index out of range.");
+        }
+        if (unfused_op(op) != 0 && !IS_NUMBER(chunk.constants[chunk.constant_index(offset)])) {
+            return fail(offset, "superinstruction with a constant that isn't a number.");
+        }
+
+        if (has_slot_operand(op) && chunk.code[offset + 1] >= depth) {
+            return fail(offset, "stack slot out of range.");
+        }
+
+        depth -= info.pops;
+        if (depth < 0) {
+            return fail(offset, "stack underflow.");
+        }
+        depth += info.pushes;
+        if (depth > max_depth) { max_depth = depth; }
+
+        StaticType result = Types::result_type((OpCode)op);
+        if (op == OP_Constant || op == OP_Constant_Long) {
+            result = Types::type_of(chunk.constants[chunk.constant_index(offset)]);
+        }
+        if (op == OP_Get_Slot) { result = types[chunk.code[offset + 1]]; }
+        if (op == OP_Set_Slot) { result = types[chunk.code[offset + 1]] = types.back(); }
+        for (int n = 0; n < info.pops; ++n) {
+            if (is_unchecked(op) && types.back() != StaticType::Number) {
+                return fail(offset, "unchecked arithmetic on a value that may not be a number.");
+            }
+            types.pop_back();
+        }
+        if (info.pushes > 0) { types.push_back(result); }
+
+        returned = (op == OP_Return);
+        offset += 1 + info.operands;
+    }
+
+    if (!returned) {
+        return fail(size, "chunk doesn't end with a return.");
+    }
+    if (max_depth > chunk.max_stack) {
+        return fail(size, "stack grows beyond the chunks max_stack.");
+    }
+    return true;
+}
+
+static inline bool verify(ChunkView const& chunk)
+{
+    std::vector<StaticType> types;
+    return verify(chunk, types);
+}
+
+}